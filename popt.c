@@ -22,7 +22,23 @@ extern long long int strtoll(const char *nptr, /*@null@*/ char **endptr,
 #ifdef HAVE_FLOAT_H
 #include <float.h>
 #endif
+#if defined(HAVE_LOCALE_H)
+#include <locale.h>
+#endif
 #include <math.h>
+#include <stddef.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+
+/* XXX let's not demand C99 compiler flags for <limits.h> quite yet. */
+#if !defined(LLONG_MAX)
+#   define LLONG_MAX    9223372036854775807LL
+#   define LLONG_MIN    (-LLONG_MAX - 1LL)
+#endif
 
 #include "poptint.h"
 #if defined(HAVE_ASSERT_H)
@@ -78,53 +94,39 @@ void poptSetExecPath(poptContext con, const char * path, int allowAbsolute)
     return;
 }
 
-static void invokeCallbacksPRE(poptContext con, const struct poptOption * opt)
+static void invokeCallbacksPRE(poptContext con)
 	/*@globals internalState@*/
 	/*@modifies internalState@*/
 {
-    if (opt != NULL)
-    for (; opt->longName || opt->shortName || opt->arg; opt++) {
-    poptArg arg;
-    arg.ptr = opt->arg;
-	if (arg.ptr)
-	switch (poptArgType(opt)) {
-	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
-	    invokeCallbacksPRE(con, arg.opt);
-	    /*@switchbreak@*/ break;
-	case POPT_ARG_CALLBACK:		/* Perform callback. */
-	    if (!CBF_ISSET(opt, PRE))
-		/*@switchbreak@*/ break;
+    int i;
+
+    for (i = 0; i < con->table->ncallbacks; i++) {
+	const struct poptOption * opt = con->table->callbacks[i];
+	poptArg arg;
+	arg.ptr = opt->arg;
+	if (!CBF_ISSET(opt, PRE))
+	    continue;
 /*@-noeffectuncon @*/	/* XXX no known way to annotate (*vector) calls. */
-	    arg.cb(con, POPT_CALLBACK_REASON_PRE, NULL, NULL, opt->descrip);
+	arg.cb(con, POPT_CALLBACK_REASON_PRE, NULL, NULL, opt->descrip);
 /*@=noeffectuncon @*/
-	    /*@switchbreak@*/ break;
-	}
     }
 }
 
-static void invokeCallbacksPOST(poptContext con, const struct poptOption * opt)
+static void invokeCallbacksPOST(poptContext con)
 	/*@globals internalState@*/
 	/*@modifies internalState@*/
 {
-    if (opt != NULL)
-    for (; opt->longName || opt->shortName || opt->arg; opt++) {
-    poptArg arg;
-    arg.ptr = opt->arg;
-	if (arg.ptr)
-	switch (poptArgType(opt)) {
-	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
-	    invokeCallbacksPOST(con, arg.opt);
-	    /*@switchbreak@*/ break;
-	case POPT_ARG_CALLBACK:		/* Perform callback. */
-	    if (!CBF_ISSET(opt, POST))
-		/*@switchbreak@*/ break;
+    int i;
+
+    for (i = 0; i < con->table->ncallbacks; i++) {
+	const struct poptOption * opt = con->table->callbacks[i];
+	poptArg arg;
+	arg.ptr = opt->arg;
+	if (!CBF_ISSET(opt, POST))
+	    continue;
 /*@-noeffectuncon @*/	/* XXX no known way to annotate (*vector) calls. */
-	    arg.cb(con, POPT_CALLBACK_REASON_POST, NULL, NULL, opt->descrip);
+	arg.cb(con, POPT_CALLBACK_REASON_POST, NULL, NULL, opt->descrip);
 /*@=noeffectuncon @*/
-	    /*@switchbreak@*/ break;
-	}
     }
 }
 
@@ -176,205 +178,1364 @@ static void invokeCallbacksOPTION(poptContext con,
     }
 }
 
-poptContext poptGetContext(const char * name, int argc, const char ** argv,
-			const struct poptOption * options, unsigned int flags)
+/**
+ * Return length of a POPT_ARGFLAG_TOGGLE "no" or "no-" long name prefix.
+ * @param s		long option name
+ * @param ns		long option name length
+ * @return		no. of prefix bytes to skip (0 if none)
+ */
+static size_t poptTogglePrefix(const char * s, size_t ns)
+	/*@*/
 {
-    poptContext con = (poptContext) xcalloc(1, sizeof(*con));
+    size_t np = 0;
 
-assert(con);	/* XXX can't happen */
-    if (con == NULL) return NULL;
+    if (ns >= (sizeof("no") - 1) && s[0] == 'n' && s[1] == 'o') {
+	np = sizeof("no") - 1;
+	if (ns > np && s[np] == '-')
+	    np++;
+    }
+    return np;
+}
 
-    con->optionDepth = POPTINT_OPTION_DEPTH;
-    con->os = con->optionStack;
+poptCompiledTable poptFreeCompiledTable(poptCompiledTable t)
+{
+    /* A table compiled in an arena goes away with the arena. */
+    if (t != NULL && t->arena == NULL) {
+	t->entries = _free(t->entries);
+	t->keys = _free(t->keys);
+	t->slots = _free(t->slots);
+	t->names = _free(t->names);
+	t->nodes = _free(t->nodes);
+	t->callbacks = _free(t->callbacks);
+	t->strings = _free(t->strings);
+	t->calcs = _free(t->calcs);
+	t->insns = _free(t->insns);
+	t = _free(t);
+    }
+    return NULL;
+}
 
-#ifdef	SUPPORT_GLOBAL_CALCULATOR
-    con->calcDepth = POPTINT_CALC_DEPTH;
-    con->stk = con->calcStack;
-#endif
+/**
+ * Flatten the matchable options in a table (and its sub-tables).
+ * Without entries and callbacks arrays, the options are only counted.
+ * @param t		compiled table
+ * @param opt		option table
+ */
+static void poptTableFlatten(poptCompiledTable t, const struct poptOption * opt)
+	/*@modifies t @*/
+{
+    const struct poptOption * cb = NULL;
 
-    con->os->argc = argc;
-/*@-dependenttrans -assignexpose@*/	/* FIX: W2DO? */
-    con->os->argv = argv;
-/*@=dependenttrans =assignexpose@*/
-    con->os->argb = NULL;
+    for (; opt->longName || opt->shortName || opt->arg; opt++) {
+	poptTableEntry e;
+	poptArg arg;
+	arg.ptr = opt->arg;
 
-    if (!(flags & POPT_CONTEXT_KEEP_FIRST))
-	con->os->next = 1;		/* skip argv[0] */
+	switch (poptArgType(opt)) {
+	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
+	{   int i = t->nentries;
 
-    con->leftovers = (poptArgv) xcalloc( (size_t)(argc + 1), sizeof(*con->leftovers) );
+	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
+	    if (arg.ptr == NULL) continue;	/* XXX program error */
+	    poptTableFlatten(t, arg.opt);
+	    /* Sub-table data will be inheirited if no data yet. */
+	    if (t->entries != NULL)
+	    for (; i < t->nentries; i++) {
+		e = t->entries + i;
+		if (e->callback && e->callbackData == NULL)
+		    e->callbackData = opt->descrip;
+	    }
+	}   continue;
+	    /*@notreached@*/ /*@switchbreak@*/ break;
+	case POPT_ARG_CALLBACK:
+	    cb = opt;
+	    /* Table callbacks are also invoked at PRE and POST time. */
+	    if (arg.ptr != NULL) {
+		if (t->callbacks != NULL)
+		    t->callbacks[t->ncallbacks] = opt;
+		t->ncallbacks++;
+	    }
+	    continue;
+	    /*@notreached@*/ /*@switchbreak@*/ break;
+	default:
+	    /*@switchbreak@*/ break;
+	}
 
-/*@-dependenttrans -assignexpose@*/	/* FIX: W2DO? */
-    con->options = options;
-/*@=dependenttrans =assignexpose@*/
+	if (t->entries != NULL) {
+	    e = t->entries + t->nentries;
+	    e->opt = opt;
+	    arg.ptr = (cb ? cb->arg : NULL);
+	    e->callback = arg.cb;
+/*@-observertrans -dependenttrans @*/
+	    e->callbackData = (cb && !CBF_ISSET(cb, INC_DATA) ? cb->descrip : NULL);
+/*@=observertrans =dependenttrans @*/
+	}
+	t->nentries++;
+    }
+}
 
-    con->aliases = NULL;
-    con->numAliases = 0;
+/**
+ * Return the first key record with a given long option name.
+ * @param t		compiled table
+ * @param s		long option name
+ * @param ns		long option name length
+ * @return		key record number (or -1 if not found)
+ */
+static int poptTableProbe(const poptCompiledTable t, const char * s, size_t ns)
+	/*@*/
+{
+    uint32_t h0 = 0;
+    uint32_t h1 = 0;
+    uint32_t j;
+    int i;
 
-    con->flags = flags;
-    con->execs = NULL;
-    con->numExecs = 0;
+    /* A (generated) matcher has already compared the name. */
+    if (t->matcher != NULL) {
+	i = t->matcher->match(s, ns);
+	return (i >= 0 && i < t->matcher->nmatch ? t->slots[i] : -1);
+    }
 
-    con->nav = argc * 2;
-    con->av = (poptArgv) xcalloc( (size_t)con->nav, sizeof(*con->av) );
-    con->execAbsolute = 1;
-    con->arg_strip = NULL;
+    poptJlu32lpair(s, ns, &h0, &h1);
+    for (j = h0 & t->mask; (i = t->slots[j]) >= 0; j = (j + 1) & t->mask) {
+	poptTableKey k = t->keys + i;
+	if (k->keyLen == ns && !memcmp(k->key, s, ns))
+	    break;
+    }
+    return i;
+}
 
-    if (getenv("POSIXLY_CORRECT") || getenv("POSIX_ME_HARDER"))
-	con->flags |= POPT_CONTEXT_POSIXMEHARDER;
+/**
+ * Add a long option name to a compiled table.
+ * Records with equal names are chained in table order, first match first.
+ * @param t		compiled table
+ * @param s		long option name
+ * @param ns		long option name length
+ * @param entry		option entry number
+ * @return		0 on success, -1 if the matcher does not know the name
+ */
+static int poptTableAddKey(poptCompiledTable t, const char * s, size_t ns,
+		int entry)
+	/*@modifies t @*/
+{
+    poptTableKey k = t->keys + t->nkeys;
+    uint32_t j = 0;
+    int i;
 
-    if (name)
-	con->appName = xstrdup(name);
+    k->key = s;
+    k->keyLen = ns;
+    k->entry = entry;
+    k->next = -1;
+
+    if (t->matcher != NULL) {
+	/* Every name must have its own match number. */
+	i = t->matcher->match(s, ns);
+	if (i < 0 || i >= t->matcher->nmatch)
+	    return -1;
+	j = (uint32_t) i;
+	i = t->slots[j];
+	if (i >= 0 && (t->keys[i].keyLen != ns || memcmp(t->keys[i].key, s, ns)))
+	    return -1;
+    } else
+	i = poptTableProbe(t, s, ns);
+
+    if (i >= 0) {
+	while (t->keys[i].next >= 0)
+	    i = t->keys[i].next;
+	t->keys[i].next = t->nkeys;
+    } else {
+	if (t->matcher == NULL) {
+	    uint32_t h0 = 0;
+	    uint32_t h1 = 0;
+
+	    poptJlu32lpair(s, ns, &h0, &h1);
+	    for (j = h0 & t->mask; t->slots[j] >= 0; j = (j + 1) & t->mask)
+		{};
+	}
+	t->slots[j] = t->nkeys;
+    }
+    t->nkeys++;
+    return 0;
+}
 
-    invokeCallbacksPRE(con, con->options);
+/**
+ * Compare two long option names, ordering a prefix before its extensions.
+ */
+static int poptTableKeyCmp(const poptTableKey a, const poptTableKey b)
+	/*@*/
+{
+    size_t n = (a->keyLen < b->keyLen ? a->keyLen : b->keyLen);
+    int rc = memcmp(a->key, b->key, n);
+    if (rc == 0)
+	rc = (a->keyLen > b->keyLen) - (a->keyLen < b->keyLen);
+    return rc;
+}
 
-    return con;
+/**
+ * Sort key record numbers by long option name (a merge sort).
+ * @param t		compiled table
+ * @param names		key record numbers
+ * @param tmp		scratch space (same size as names)
+ * @param n		no. of key record numbers
+ */
+static void poptTableSort(const poptCompiledTable t, int * names, int * tmp,
+		int n)
+	/*@modifies names, tmp @*/
+{
+    int h = n / 2;
+    int i, j, k;
+
+    if (n < 2)
+	return;
+    poptTableSort(t, names, tmp, h);
+    poptTableSort(t, names + h, tmp, n - h);
+    for (i = 0, j = h, k = 0; i < h && j < n; k++)
+	tmp[k] = (poptTableKeyCmp(t->keys + names[j], t->keys + names[i]) < 0
+		? names[j++] : names[i++]);
+    while (i < h)
+	tmp[k++] = names[i++];
+    memcpy(names, tmp, k * sizeof(*names));
 }
 
-static void cleanOSE(/*@special@*/ struct optionStackEntry *os)
-	/*@uses os @*/
-	/*@releases os->nextArg, os->argv, os->argb @*/
-	/*@modifies os @*/
+/**
+ * Combine the entries that two sets of long option names resolve to.
+ */
+static int poptTableResolve(int a, int b)
+	/*@*/
 {
-#if !defined(SUPPORT_CONTIGUOUS_ARGV)
-    int i;
-    for (i = 0; os->argv[i]; i++)
-	os->argv[i] = _free(os->argv[i]);
-#endif
-    os->argv = _free(os->argv);
-    os->argb = PBM_FREE(os->argb);
-    os->nextArg = _free(os->nextArg);
+    if (a == -1 || a == b)
+	return b;
+    if (b == -1)
+	return a;
+    return -2;
 }
 
-void poptResetContext(poptContext con)
+/**
+ * Build the abbreviation trie node for a range of sorted names.
+ * @param t		compiled table
+ * @param lo		first sorted name
+ * @param hi		last sorted name + 1
+ * @param depth		length of the prefix shared by the names
+ * @return		trie node number
+ */
+static int poptTableTrie(poptCompiledTable t, int lo, int hi, size_t depth)
+	/*@modifies t @*/
 {
-    if (con == NULL) return;
-    while (con->os > con->optionStack) {
-	cleanOSE(con->os--);
+    const poptTableKey a = t->keys + t->names[lo];
+    const poptTableKey b = t->keys + t->names[hi - 1];
+    int x = t->nnodes++;
+    int prev = -1;
+    int i = lo;
+
+    /* Sorted names share the prefix of the first and last name. */
+    while (depth < a->keyLen && depth < b->keyLen
+	&& a->key[depth] == b->key[depth])
+	depth++;
+    t->nodes[x].name = lo;
+    t->nodes[x].depth = depth;
+    t->nodes[x].child = -1;
+    t->nodes[x].sibling = -1;
+    t->nodes[x].entry = -1;
+
+    /* A name that ends here sorts first, and resolves to its first entry. */
+    if (a->keyLen == depth) {
+	t->nodes[x].entry = a->entry;
+	i++;
     }
-    con->os->argb = PBM_FREE(con->os->argb);
-    con->os->currAlias = NULL;
-    con->os->nextCharArg = NULL;
-    con->os->nextArg = NULL;
-    con->os->next = 1;			/* skip argv[0] */
+    while (i < hi) {
+	char c = t->keys[t->names[i]].key[depth];
+	int j = i + 1;
+	int y;
+
+	while (j < hi && t->keys[t->names[j]].key[depth] == c)
+	    j++;
+	y = poptTableTrie(t, i, j, depth + 1);
+	if (prev < 0)
+	    t->nodes[x].child = y;
+	else
+	    t->nodes[prev].sibling = y;
+	t->nodes[x].entry = poptTableResolve(t->nodes[x].entry, t->nodes[y].entry);
+	prev = y;
+	i = j;
+    }
+    return x;
+}
 
-    con->numLeftovers = 0;
-    con->nextLeftover = 0;
-    con->restLeftover = 0;
-    con->doExec = NULL;
+/**
+ * Compile a POPT_ARGFLAG_CALCULATOR RPN expression.
+ * How deep the expression reaches into, and how high it grows, the stack
+ * (arg0 and arg1 to start) is found here, once, so that evaluation checks
+ * the stack bounds just once, and otherwise only checks division by zero.
+ * @param expr		RPN expression
+ * @retval calc		compiled calculator (NULL only counts instructions)
+ * @return		no. of instructions
+ */
+static int poptCalcCompile(const char * expr, /*@null@*/ poptCalc calc)
+	/*@modifies calc @*/
+{
+    const char * se;
+    int ix = 2;
+    int rc = 0;
+    int n = 0;
 
-    if (con->av != NULL) {
-    unsigned int i;
-     for (i = 0; i < con->ac; i++) {
-/*@-unqualifiedtrans@*/		/* FIX: typedef double indirection. */
- 	con->av[i] = _free(con->av[i]);
-/*@=unqualifiedtrans@*/
-     }
+    if (calc != NULL) {
+	calc->need = 0;
+	calc->peak = 0;
     }
 
-    con->ac = 0;
-    con->arg_strip = PBM_FREE(con->arg_strip);
-/*@-nullstate@*/	/* FIX: con->av != NULL */
-    return;
-/*@=nullstate@*/
+    for (; *expr != '\0'; expr = se) {
+	poptCalcInsn i;
+
+	while (*expr != '\0' && _isspaceptr(expr))
+	    expr++;
+	if (*expr == '\0')
+	    break;
+	for (se = expr; *se != '\0' && !_isspaceptr(se); se++)
+	    {};
+	if (calc == NULL || rc != 0) {
+	    n++;
+	    continue;
+	}
+	i = calc->insns + n++;
+	i->val = 0;
+	i->op = 0;
+	if (se - expr > 1) {
+	    char * end = NULL;
+	    i->val = strtoll(expr, &end, 0);
+	    if (end != se)
+		rc = POPT_ERROR_BADNUMBER;
+	    ix++;
+	} else {
+	    /* Every operator pops (at least) 1 of 2 values. */
+	    i->op = (int) *expr;
+	    if (calc->need < 2 - ix)
+		calc->need = 2 - ix;
+	    switch (i->op) {
+	    case 'd':	ix++;	/*@switchbreak@*/ break;	/* duplicate */
+	    case 'P':	ix--;	/*@switchbreak@*/ break;	/* pop */
+	    case 'r':		/*@switchbreak@*/ break;	/* reverse */
+	    case '=': case '|': case '&': case '^':
+	    case '+': case '-': case '*': case '/': case '%':
+		ix--;
+		/*@switchbreak@*/ break;
+	    default:
+		rc = POPT_ERROR_BADOPERATION;
+		/*@switchbreak@*/ break;
+	    }
+	}
+	if (calc->peak < ix - 2)
+	    calc->peak = ix - 2;
+    }
+    if (calc != NULL) {
+	/* The result is on top. */
+	if (calc->need < 1 - ix)
+	    calc->need = 1 - ix;
+	calc->rc = rc;
+    }
+    return n;
 }
 
-/* Only one of longName, shortName should be set, not both. */
-static int handleExec(/*@special@*/ poptContext con,
-		/*@null@*/ const char * longName, char shortName)
-	/*@uses con->execs, con->numExecs, con->flags, con->doExec,
-		con->av, con->nav, con->ac @*/
-	/*@modifies con @*/
+/**
+ * Allocate zeroed memory for a compiled table, from its arena if it has one.
+ * @param t		compiled table
+ * @param nmemb		no. of members
+ * @param size		member size
+ * @return		memory (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static void * poptTableCalloc(poptCompiledTable t, size_t nmemb, size_t size)
+	/*@modifies t @*/
 {
-    poptItem item;
+    return (t->arena ? poptArenaCalloc(t->arena, nmemb, size)
+		: xcalloc(nmemb, size));
+}
+
+/**
+ * Compile an option table, into an arena or with malloc.
+ * @param options	option table
+ * @param matcher	long option matcher (or NULL)
+ * @param a		arena (or NULL)
+ * @return		compiled table (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static poptCompiledTable poptTableCompile(const struct poptOption * options,
+		/*@null@*/ const struct poptMatcher * matcher,
+		/*@null@*/ poptArena a)
+	/*@modifies a @*/
+{
+    poptCompiledTable t = (poptCompiledTable)
+		(a ? poptArenaCalloc(a, 1, sizeof(*t)) : xcalloc(1, sizeof(*t)));
+    uint32_t nslots = 16;
+    size_t nb = 0;
+    char * te;
+    int nkeys = 0;
     int i;
 
-    if (con->execs == NULL || con->numExecs <= 0)
-	return 0;
+    if (t == NULL)
+	return NULL;
+    t->options = options;
+    t->matcher = matcher;
+    t->arena = a;
+
+    /* Count, then flatten, the options in table traversal order. */
+    if (options != NULL)
+	poptTableFlatten(t, options);
+    t->entries = (poptTableEntry)
+		poptTableCalloc(t, t->nentries + 1, sizeof(*t->entries));
+    t->callbacks = (const struct poptOption **)
+		poptTableCalloc(t, t->ncallbacks + 1, sizeof(*t->callbacks));
+    if (t->entries == NULL || t->callbacks == NULL)
+	return poptFreeCompiledTable(t);
+    t->nentries = 0;
+    t->ncallbacks = 0;
+    if (options != NULL)
+	poptTableFlatten(t, options);
+
+    /* Compile each calculator expression once, for every evaluation. */
+    {	int ncalcs = 0;
+	int ninsns = 0;
+	for (i = 0; i < t->nentries; i++) {
+	    const struct poptOption * opt = t->entries[i].opt;
+	    if (!F_ISSET(opt, CALCULATOR) || opt->argDescrip == NULL)
+		continue;
+	    ncalcs++;
+	    ninsns += poptCalcCompile(opt->argDescrip, NULL);
+	}
+	if (ncalcs > 0) {
+	    t->calcs = (poptCalc) poptTableCalloc(t, ncalcs, sizeof(*t->calcs));
+	    t->insns = (poptCalcInsn)
+			poptTableCalloc(t, ninsns + 1, sizeof(*t->insns));
+	    if (t->calcs == NULL || t->insns == NULL)
+		return poptFreeCompiledTable(t);
+	    ncalcs = ninsns = 0;
+	    for (i = 0; i < t->nentries; i++) {
+		const struct poptOption * opt = t->entries[i].opt;
+		poptCalc calc;
+		if (!F_ISSET(opt, CALCULATOR) || opt->argDescrip == NULL)
+		    continue;
+		calc = t->entries[i].calc = t->calcs + ncalcs++;
+		calc->insns = t->insns + ninsns;
+		calc->ninsns = poptCalcCompile(opt->argDescrip, calc);
+		ninsns += calc->ninsns;
+	    }
+	}
+    }
 
-    for (i = con->numExecs - 1; i >= 0; i--) {
-	item = con->execs + i;
-	if (longName && !(item->option.longName &&
-			!strcmp(longName, item->option.longName)))
+    /* A toggle is also keyed by its "no" and "no-" names. */
+    for (i = 0; i < t->nentries; i++) {
+	const struct poptOption * opt = t->entries[i].opt;
+	if (poptArgType(opt) == POPT_ARG_MAINCALL)
+	    t->nmaincalls++;
+	if (opt->longName == NULL)
 	    continue;
-	else if (shortName != item->option.shortName)
-	    continue;
-	break;
+	nkeys++;
+	if (F_ISSET(opt, TOGGLE)) {
+	    nkeys += 2;
+	    nb += 2 * strlen(opt->longName) + sizeof("no") + sizeof("no-");
+	}
     }
-    if (i < 0) return 0;
 
+    /* Keep the load factor at or below 1/2, or index by match number. */
+    if (matcher != NULL)
+	nslots = (uint32_t) matcher->nmatch + 1;
+    else
+    while (nslots < 2U * (uint32_t)nkeys)
+	nslots <<= 1;
+    t->mask = nslots - 1;
+    t->slots = (int *) poptTableCalloc(t, nslots, sizeof(*t->slots));
+    t->keys = (poptTableKey) poptTableCalloc(t, nkeys + 1, sizeof(*t->keys));
+    t->strings = (char *) poptTableCalloc(t, nb + 1, sizeof(*t->strings));
+    if (t->slots == NULL || t->keys == NULL || t->strings == NULL)
+	return poptFreeCompiledTable(t);
+    memset(t->slots, 0xff, nslots * sizeof(*t->slots));
+    memset(t->shorts, 0xff, sizeof(t->shorts));
+
+    te = t->strings;
+    for (i = 0; i < t->nentries; i++) {
+	const struct poptOption * opt = t->entries[i].opt;
+	const char * s = opt->longName;
+	size_t ns;
+
+	if (opt->shortName && t->shorts[(unsigned char)opt->shortName] < 0)
+	    t->shorts[(unsigned char)opt->shortName] = i;
+	if (s == NULL)
+	    continue;
+	ns = strlen(s);
+	if (!F_ISSET(opt, TOGGLE)) {
+	    if (poptTableAddKey(t, s, ns, i))
+		goto errxit;
+	    continue;
+	}
 
-    if (con->flags & POPT_CONTEXT_NO_EXEC)
-	return 1;
-
-    if (con->doExec == NULL) {
-	con->doExec = con->execs + i;
-	return 1;
+	/* Match "--[no[-]]foo" for "foo", "nofoo" or "no-foo" toggles. */
+	{   size_t np = poptTogglePrefix(s, ns);
+	    s += np;
+	    ns -= np;
+	}
+	if (poptTogglePrefix(s, ns) == 0 && poptTableAddKey(t, s, ns, i))
+	    goto errxit;
+	if (*s != '-') {
+	    const char * k = te;
+	    te = stpcpy(stpcpy(te, "no"), s) + 1;
+	    if (poptTableAddKey(t, k, ns + sizeof("no") - 1, i))
+		goto errxit;
+	}
+	{   const char * k = te;
+	    te = stpcpy(stpcpy(te, "no-"), s) + 1;
+	    if (poptTableAddKey(t, k, ns + sizeof("no-") - 1, i))
+		goto errxit;
+	}
     }
 
-    /* We already have an exec to do; remember this option for next
-       time 'round */
-    if ((con->ac + 1) >= (con->nav)) {
-	con->nav += 10;
-	con->av = (poptArgv) xrealloc(con->av, sizeof(*con->av) * con->nav);
-    }
-
-    i = con->ac++;
-assert(con->av);		/* XXX can't happen */
-    if (con->av != NULL)
-    {	char *s  = (char*) xmalloc((longName ? strlen(longName) : 0) + sizeof("--"));
-assert(s);	/* XXX can't happen */
-	if (s != NULL) {
-	    con->av[i] = s;
-	    *s++ = '-';
-	    if (longName)
-		s = stpcpy( stpcpy(s, "-"), longName);
-	    else
-		*s++ = shortName;
-	    *s = '\0';
-	} else
-	    con->av[i] = NULL;
+    /* Sort the distinct long option names (with scratch) for the trie. */
+    t->names = (int *) poptTableCalloc(t, 2 * t->nkeys + 1, sizeof(*t->names));
+    t->nodes = (poptTableNode)
+		poptTableCalloc(t, 2 * t->nkeys + 1, sizeof(*t->nodes));
+    if (t->names == NULL || t->nodes == NULL)
+	goto errxit;
+    for (i = 0; i <= (int) t->mask; i++) {
+	if (t->slots[i] >= 0)
+	    t->names[t->nnames++] = t->slots[i];
     }
+    poptTableSort(t, t->names, t->names + t->nnames, t->nnames);
+    if (t->nnames > 0)
+	(void) poptTableTrie(t, 0, t->nnames, 0);
+    return t;
 
-    return 1;
+errxit:
+    return poptFreeCompiledTable(t);
+}
+
+poptCompiledTable poptCompileTable(const struct poptOption * options)
+{
+    return poptTableCompile(options, NULL, NULL);
+}
+
+poptCompiledTable poptCompileTableMatcher(const struct poptOption * options,
+		const struct poptMatcher * matcher)
+{
+    return poptTableCompile(options, matcher, NULL);
 }
 
 /**
- * Compare long option for equality, adjusting for POPT_ARGFLAG_TOGGLE.
- * @param opt           option
- * @param longName	arg option
- * @param longNameLen	arg option length
- * @return		does long option match?
+ * Return the option entry that every name with a long option prefix has.
+ * @param t		compiled table
+ * @param s		long option prefix
+ * @param ns		long option prefix length
+ * @return		entry number (-1 if not found, -2 if ambiguous)
  */
-static int
-longOptionStrcmp(const struct poptOption * opt,
-		/*@null@*/ const char * longName, size_t longNameLen)
+static int poptTableAbbrev(const poptCompiledTable t, const char * s, size_t ns)
 	/*@*/
 {
-    const char * optLongName = opt->longName;
-    int rc;
+    size_t d = 0;
+    int x = (ns > 0 && t->nnodes > 0 ? 0 : -1);
 
-assert(optLongName && longName);	/* XXX can't heppen */
-    if (optLongName == NULL || longName == NULL)
-	return 0;
+    while (x >= 0) {
+	const poptTableNode n = t->nodes + x;
+	const char * key = t->keys[t->names[n->name]].key;
 
-    if (F_ISSET(opt, TOGGLE)) {
-	if (optLongName[0] == 'n' && optLongName[1] == 'o') {
-	    optLongName += sizeof("no") - 1;
-	    if (optLongName[0] == '-')
-		optLongName++;
+	for (; d < n->depth && d < ns; d++) {
+	    if (key[d] != s[d])
+		return -1;
 	}
-	if (longName[0] == 'n' && longName[1] == 'o') {
-	    longName += sizeof("no") - 1;
-	    longNameLen -= sizeof("no") - 1;
-	    if (longName[0] == '-') {
-		longName++;
-		longNameLen--;
-	    }
+	if (d == ns)
+	    return n->entry;
+	for (x = n->child; x >= 0; x = t->nodes[x].sibling) {
+	    if (t->keys[t->names[t->nodes[x].name]].key[d] == s[d])
+		break;
 	}
     }
-    rc = (int)(strlen(optLongName) == longNameLen);
-    if (rc)
-	rc = (int)(strncmp(optLongName, longName, longNameLen) == 0);
+    return -1;
+}
+
+/**
+ * Return the first option entry that matches a long option.
+ * @param t		compiled table
+ * @param longName	long option name
+ * @param longNameLen	long option name length
+ * @param argInfo	POPT_ARGFLAG_ONEDASH if single dash was used
+ * @return		entry number (or -1 if not found)
+ */
+static int poptTableLong(const poptCompiledTable t,
+		const char * longName, size_t longNameLen,
+		unsigned int argInfo)
+	/*@*/
+{
+    int i;
+
+    for (i = poptTableProbe(t, longName, longNameLen); i >= 0; i = t->keys[i].next) {
+	if (LF_ISSET(ONEDASH) && !F_ISSET(t->entries[t->keys[i].entry].opt, ONEDASH))
+	    continue;
+	return t->keys[i].entry;
+    }
+    return -1;
+}
+
+poptContext poptGetContext(const char * name, int argc, const char ** argv,
+			const struct poptOption * options, unsigned int flags)
+{
+    poptCompiledTable table = poptCompileTable(options);
+    poptContext con;
+
+    if (table == NULL)
+	return NULL;
+    con = poptGetCompiledContext(name, argc, argv, table, flags);
+    if (con == NULL) {
+	table = poptFreeCompiledTable(table);
+	return NULL;
+    }
+    con->privateTable = table;
+    return con;
+}
+
+/**
+ * Create a context, in a caller's block or with malloc.
+ * @param name		context name (usually argv[0] program name)
+ * @param argc		no. of arguments
+ * @param argv		argument array
+ * @param table		compiled option table
+ * @param flags		or'd POPT_CONTEXT_* bits
+ * @param block		fixed arena in a caller's block (or NULL)
+ * @return		initialized popt context (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static poptContext poptNewContext(/*@dependent@*/ /*@keep@*/ const char * name,
+			int argc, /*@dependent@*/ /*@keep@*/ const char ** argv,
+			/*@dependent@*/ /*@keep@*/ const poptCompiledTable table,
+			unsigned int flags, /*@null@*/ poptArena block)
+	/*@modifies block @*/
+{
+    poptContext con;
+
+    if (table == NULL)
+	return NULL;
+
+    if (block != NULL) {
+	/* Everything comes from the block, and nothing is kept to exec. */
+	con = (poptContext) poptArenaCalloc(block, 1, sizeof(*con));
+	if (con == NULL)
+	    return NULL;
+	con->leftovers = (poptArgv)
+		poptArenaCalloc(block, (size_t)(argc + 1), sizeof(*con->leftovers));
+	if (con->leftovers == NULL)
+	    return NULL;
+	con->maxLeftovers = argc;
+	con->block = block;
+	con->arena = block;
+    } else {
+	con = (poptContext) xcalloc(1, sizeof(*con));
+assert(con);	/* XXX can't happen */
+	if (con == NULL) return NULL;
+	con->leftovers = (poptArgv)
+		xcalloc( (size_t)(argc + 1), sizeof(*con->leftovers) );
+	con->maxLeftovers = argc;
+	if (flags & POPT_CONTEXT_ARENA)
+	    con->arena = poptArenaNew(0);
+    }
+
+    con->table = table;
+
+    con->optionDepth = POPTINT_OPTION_DEPTH;
+    con->os = con->optionStack;
+
+    con->calcDepth = POPTINT_CALC_DEPTH;
+    con->stk = con->calcStack;
+    con->calcArg = NULL;
+
+    con->os->argc = argc;
+/*@-dependenttrans -assignexpose@*/	/* FIX: W2DO? */
+    con->os->argv = argv;
+/*@=dependenttrans =assignexpose@*/
+    con->os->argb = NULL;
+
+    if (!(flags & POPT_CONTEXT_KEEP_FIRST))
+	con->os->next = 1;		/* skip argv[0] */
+
+/*@-dependenttrans -assignexpose@*/	/* FIX: W2DO? */
+    con->options = table->options;
+/*@=dependenttrans =assignexpose@*/
+
+    con->aliases = NULL;
+    con->numAliases = 0;
+    con->maxAliases = 0;
+
+    con->flags = flags;
+    con->execs = NULL;
+    con->numExecs = 0;
+    con->maxExecs = 0;
+    con->doExec = -1;
+
+    con->execAbsolute = 1;
+    con->arg_strip = NULL;
+
+    if (getenv("POSIXLY_CORRECT") || getenv("POSIX_ME_HARDER"))
+	con->flags |= POPT_CONTEXT_POSIXMEHARDER;
+
+    if (name)
+	con->appName = (block ? name : xstrdup(name));
+
+    /* Parse-time memory is released back to here by poptResetContext(). */
+    if (block != NULL)
+	poptArenaMark(block);
+
+    invokeCallbacksPRE(con);
+
+    return con;
+}
+
+poptContext poptGetCompiledContext(const char * name, int argc,
+			const char ** argv, const poptCompiledTable table,
+			unsigned int flags)
+{
+    return poptNewContext(name, argc, argv, table, flags, NULL);
+}
+
+size_t poptContextBlockSize(int argc, const struct poptOption * options)
+{
+    poptArena a = poptArenaNew(0);
+    size_t nb = 0;
+
+    if (a == NULL)
+	return 0;
+
+    /* Measure the table by compiling it, the rest is fixed per argc. */
+    if (poptTableCompile(options, NULL, a) != NULL) {
+	size_t nbits = (__PBM_IX(argc) + 1) * sizeof(__pbm_bits);
+	nb = a->total;
+	nb += POPT_ARENA_ROUND(sizeof(struct poptContext_s));
+	nb += POPT_ARENA_ROUND((argc + 1) * sizeof(const char *));
+	nb += 2 * POPT_ARENA_ROUND(nbits);	/* argb and arg_strip */
+	nb = poptArenaBlockSize(nb);
+    }
+    a = poptArenaFree(a);
+    return nb;
+}
+
+int poptGetContextBlock(poptContext * conp, const char * name,
+			int argc, const char ** argv,
+			const struct poptOption * options, unsigned int flags,
+			void * block, size_t blockSize)
+{
+    poptArena a = poptArenaInit(block, blockSize);
+    poptCompiledTable table;
+    poptContext con;
+
+    *conp = NULL;
+    if (a == NULL)
+	return POPT_ERROR_MALLOC;
+    if ((table = poptTableCompile(options, NULL, a)) == NULL)
+	return POPT_ERROR_MALLOC;
+    if ((con = poptNewContext(name, argc, argv, table, flags, a)) == NULL)
+	return POPT_ERROR_MALLOC;
+    con->privateTable = table;
+    *conp = con;
+    return 0;
+}
+
+/**
+ * Allocate parse-time memory, from the context arena if there is one.
+ * @param con		context
+ * @param nb		no. of bytes
+ * @return		memory (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static void * conAlloc(poptContext con, size_t nb)
+	/*@modifies con @*/
+{
+    return (con->arena ? poptArenaAlloc(con->arena, nb) : xmalloc(nb));
+}
+
+/*@only@*/ /*@null@*/
+static void * conCalloc(poptContext con, size_t nmemb, size_t size)
+	/*@modifies con @*/
+{
+    return (con->arena ? poptArenaCalloc(con->arena, nmemb, size)
+		: xcalloc(nmemb, size));
+}
+
+/*@only@*/ /*@null@*/
+static char * conStrdup(poptContext con, const char * s)
+	/*@modifies con @*/
+{
+    return (con->arena ? poptArenaStrdup(con->arena, s) : xstrdup(s));
+}
+
+/**
+ * Free parse-time memory, unless the context arena owns it.
+ * @param con		context
+ * @param p		memory
+ * @return		NULL always
+ */
+/*@null@*/
+static void * conFree(poptContext con, /*@only@*/ /*@null@*/ const void * p)
+	/*@modifies p @*/
+{
+    if (con->arena == NULL)
+	p = _free(p);
+    return NULL;
+}
+
+/**
+ * Resize memory that lasts as long as the context (aliases, execs, help).
+ * A context in a caller's block takes it from the block, kept across resets.
+ * @param con		context
+ * @param p		memory (NULL allocates)
+ * @param onb		old no. of bytes
+ * @param nb		new no. of bytes
+ * @return		memory (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static void * conKeepRealloc(poptContext con, /*@only@*/ /*@null@*/ void * p,
+		size_t onb, size_t nb)
+	/*@modifies con, p @*/
+{
+    void * q;
+
+    if (con->block == NULL)
+	return xrealloc(p, nb);
+    if ((q = poptArenaRealloc(con->block, p, onb, nb)) != NULL)
+	poptArenaMark(con->block);
+    return q;
+}
+
+/*@only@*/ /*@null@*/
+static char * conKeepStrdup(poptContext con, const char * s)
+	/*@modifies con @*/
+{
+    char * t;
+
+    if (con->block == NULL)
+	return xstrdup(s);
+    if ((t = poptArenaStrdup(con->block, s)) != NULL)
+	poptArenaMark(con->block);
+    return t;
+}
+
+/*@null@*/
+static void * conKeepFree(poptContext con, /*@only@*/ /*@null@*/ const void * p)
+	/*@modifies p @*/
+{
+    if (con->block == NULL)
+	p = _free(p);
+    return NULL;
+}
+
+/**
+ * Duplicate an argument array as parse-time memory.
+ * @param con		context
+ * @param argc		no. of arguments
+ * @param argv		argument array
+ * @retval *argcPtr	no. of arguments
+ * @retval *argvPtr	argument array copy
+ * @return		0 on success, POPT_ERROR_* on failure
+ */
+static int conDupArgv(poptContext con, int argc, const char ** argv,
+		/*@out@*/ int * argcPtr, /*@out@*/ const char *** argvPtr)
+	/*@modifies con, *argcPtr, *argvPtr @*/
+{
+    const char ** argv2;
+    int i;
+
+    if (con->arena == NULL)
+	return poptDupArgv(argc, argv, argcPtr, argvPtr);
+
+    if (argc <= 0 || argv == NULL)	/* XXX can't happen */
+	return POPT_ERROR_NOARG;
+    argv2 = (const char **) poptArenaAlloc(con->arena,
+			(argc + 1) * sizeof(*argv2));
+    if (argv2 == NULL)
+	return POPT_ERROR_MALLOC;
+    for (i = 0; i < argc; i++) {
+	if (argv[i] == NULL || (argv2[i] = conStrdup(con, argv[i])) == NULL)
+	    return (argv[i] == NULL ? POPT_ERROR_NOARG : POPT_ERROR_MALLOC);
+    }
+    argv2[argc] = NULL;
+    *argvPtr = argv2;
+    *argcPtr = argc;
+    return 0;
+}
+
+/**
+ * Free an option argument, unless it is borrowed.
+ * @param con		context
+ * @param os		option stack entry
+ * @return		NULL always
+ */
+/*@null@*/
+static char * conFreeArg(poptContext con, struct optionStackEntry * os)
+	/*@modifies os @*/
+{
+    if (os->nextArgOwned)
+	os->nextArg = conFree(con, os->nextArg);
+    os->nextArgOwned = 0;
+    return NULL;
+}
+
+static void cleanOSE(poptContext con, /*@special@*/ struct optionStackEntry *os)
+	/*@uses os @*/
+	/*@releases os->nextArg, os->argv, os->argb @*/
+	/*@modifies os @*/
+{
+    /* Only stuffed arguments are copies, alias arguments are borrowed. */
+    if (os->stuffed) {
+#if !defined(SUPPORT_CONTIGUOUS_ARGV)
+	int i;
+	if (con->arena == NULL)
+	for (i = 0; os->argv[i]; i++)
+	    os->argv[i] = _free(os->argv[i]);
+#endif
+	os->argv = conFree(con, os->argv);
+    } else if (os->currAlias == NULL || os->argv != os->currAlias->argv)
+	os->argv = conFree(con, os->argv);
+    os->argv = NULL;
+    os->argb = conFree(con, os->argb);
+    os->nextArg = conFreeArg(con, os);
+}
+
+void poptResetContext(poptContext con)
+{
+    if (con == NULL) return;
+    while (con->os > con->optionStack) {
+	cleanOSE(con, con->os--);
+    }
+    /* Keep (cleared) argv bit maps for the next parse, unless in an arena. */
+    if (con->arena != NULL)
+	con->os->argb = NULL;
+    else if (con->os->argb != NULL)
+	memset(con->os->argb, 0,
+		(__PBM_IX(con->os->argc) + 1) * sizeof(*con->os->argb));
+    con->os->currAlias = NULL;
+    con->os->nextCharArg = NULL;
+    con->os->nextArg = conFreeArg(con, con->os);
+    con->os->next = 1;			/* skip argv[0] */
+
+    con->numLeftovers = 0;
+    con->nextLeftover = 0;
+    con->restLeftover = 0;
+    con->doExec = -1;
+
+    if (con->av != NULL) {
+    size_t i;
+     for (i = 0; i < con->ac; i++)
+ 	con->av[i].arg = conFree(con, con->av[i].arg);
+    }
+
+    con->ac = 0;
+    con->stk = con->calcStack;
+    con->calcArg = NULL;
+    con->nsaves = 0;
+    if (con->arena != NULL)
+	con->arg_strip = NULL;
+    else if (con->arg_strip != NULL)
+	memset(con->arg_strip, 0,
+		(__PBM_IX(con->os->argc) + 1) * sizeof(*con->arg_strip));
+
+    /* Everything allocated from the arena is gone, all at once. */
+    if (con->arena != NULL)
+	poptArenaReset(con->arena);
+/*@-nullstate@*/	/* FIX: con->av != NULL */
+    return;
+/*@=nullstate@*/
+}
+
+int poptRebindContext(poptContext con, int argc, const char ** argv)
+{
+    if (con == NULL || argc < 0 || argv == NULL)
+	return POPT_ERROR_NOARG;
+
+    poptResetContext(con);
+
+    /* Grow leftovers (geometrically), nothing else is reallocated. */
+    if (argc > con->maxLeftovers) {
+	int n = 2 * con->maxLeftovers;
+	poptArgv leftovers;
+
+	if (con->block != NULL)
+	    return POPT_ERROR_MALLOC;
+	if (n < argc)
+	    n = argc;
+	leftovers = (poptArgv) xrealloc(con->leftovers,
+			(size_t)(n + 1) * sizeof(*con->leftovers));
+	if (leftovers == NULL)
+	    return POPT_ERROR_MALLOC;
+	con->leftovers = leftovers;
+	con->maxLeftovers = n;
+    }
+
+    /* Argv bit maps sized for fewer arguments are reallocated on demand. */
+    if (argc > con->os->argc) {
+	con->os->argb = conFree(con, con->os->argb);
+	con->arg_strip = conFree(con, con->arg_strip);
+    }
+
+    con->os->argc = argc;
+/*@-dependenttrans -assignexpose@*/
+    con->os->argv = argv;
+/*@=dependenttrans =assignexpose@*/
+    con->os->next = (con->flags & POPT_CONTEXT_KEEP_FIRST) ? 0 : 1;
+
+    invokeCallbacksPRE(con);
+
+    return 0;
+}
+
+/**
+ * Remember an option (and its argument) for an exec or main call.
+ * @param con		context
+ * @param opt		option (NULL for an exec item)
+ * @param exec		exec item (if opt is NULL)
+ * @param shortName	short name seen (or '\0' for the long name)
+ * @param arg		option argument (or NULL)
+ * @return		0 on success, POPT_ERROR_MALLOC on failure
+ */
+static int poptAvAdd(poptContext con, /*@null@*/ const struct poptOption * opt,
+		int exec, char shortName, /*@null@*/ const char * arg)
+	/*@modifies con @*/
+{
+    poptAvItem av;
+
+    if (con->ac == con->nav) {
+	size_t nav = (con->nav > 0 ? 2 * con->nav : 16);
+	av = (poptAvItem) xrealloc(con->av, nav * sizeof(*av));
+	if (av == NULL)
+	    return POPT_ERROR_MALLOC;
+	con->av = av;
+	con->nav = nav;
+    }
+
+    /* An arena argument lasts until the reset, others may be given away. */
+    av = con->av + con->ac;
+    av->opt = opt;
+    av->exec = exec;
+    av->shortName = shortName;
+    av->arg = NULL;
+    if (arg != NULL
+     && (av->arg = (con->arena ? arg : conStrdup(con, arg))) == NULL)
+	return POPT_ERROR_MALLOC;
+    con->ac++;
+    return 0;
+}
+
+/**
+ * Return the option an exec or main call argument was seen as.
+ * @param con		context
+ * @param av		option seen
+ * @return		option
+ */
+static const struct poptOption * poptAvOption(poptContext con,
+		const poptAvItem av)
+	/*@*/
+{
+    return (av->opt != NULL ? av->opt : &con->execs[av->exec].option);
+}
+
+/**
+ * Build the argument array of the options seen so far, in one block.
+ * @param con		context
+ * @retval *acp		no. of arguments
+ * @return		argument array (malloc'd, NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static poptArgv poptAvArgv(poptContext con, /*@out@*/ int * acp)
+	/*@modifies *acp @*/
+{
+    poptArgv argv;
+    size_t nb = 0;
+    size_t i;
+    char * te;
+    int ac = 0;
+
+    for (i = 0; i < con->ac; i++) {
+	const poptAvItem av = con->av + i;
+	nb += (av->shortName ? 1 : strlen(poptAvOption(con, av)->longName))
+		+ sizeof("--");
+	ac++;
+	if (av->arg != NULL) {
+	    nb += strlen(av->arg) + 1;
+	    ac++;
+	}
+    }
+
+    argv = (poptArgv) xmalloc((ac + 1) * sizeof(*argv) + nb);
+    if (argv == NULL)
+	return NULL;
+    te = (char *) (argv + ac + 1);
+    ac = 0;
+    for (i = 0; i < con->ac; i++) {
+	const poptAvItem av = con->av + i;
+	argv[ac++] = te;
+	*te++ = '-';
+	if (av->shortName) {
+	    *te++ = av->shortName;
+	    *te++ = '\0';
+	} else {
+	    const struct poptOption * opt = poptAvOption(con, av);
+	    if (!F_ISSET(opt, ONEDASH))
+		*te++ = '-';
+	    te = stpcpy(te, opt->longName) + 1;
+	}
+	if (av->arg != NULL) {
+	    argv[ac++] = te;
+	    te = stpcpy(te, av->arg) + 1;
+	}
+    }
+    argv[ac] = NULL;
+    *acp = ac;
+    return argv;
+}
+
+/* Bit map of short option characters with an alias or exec. */
+#define	ITEMSHORT_SET(_con, _c)	\
+    ((_con)->itemShorts[__PBM_IX((unsigned char)(_c))] |= \
+	__PBM_MASK((unsigned char)(_c)))
+#define	ITEMSHORT_ISSET(_con, _c)	\
+    (((_con)->itemShorts[__PBM_IX((unsigned char)(_c))] & \
+	__PBM_MASK((unsigned char)(_c))) != 0)
+
+/**
+ * Return the long name that an alias or exec item is indexed by.
+ * @param item		alias or exec item
+ * @param aliases	alias (1) or exec (0) item?
+ * @retval *nsp		long name length
+ * @return		long name (NULL if not indexed)
+ */
+/*@null@*/
+static const char * poptItemName(const poptItem item, int aliases,
+		/*@out@*/ size_t * nsp)
+	/*@modifies *nsp @*/
+{
+    const char * s = item->option.longName;
+    size_t ns;
+
+    if (s == NULL)
+	return NULL;
+    /* handleExec() matches long names only for items without a short name. */
+    if (!aliases && item->option.shortName)
+	return NULL;
+    ns = strlen(s);
+    /* Toggle aliases match longOptionStrcmp() style, without "no"/"no-". */
+    if (aliases && F_ISSET(&item->option, TOGGLE)) {
+	size_t np = poptTogglePrefix(s, ns);
+	s += np;
+	ns -= np;
+    }
+    *nsp = ns;
+    return s;
+}
+
+/**
+ * Return the slot for an alias or exec item long name.
+ * @param ix		item index
+ * @param items		alias or exec items
+ * @param aliases	alias (1) or exec (0) items?
+ * @param s		long name
+ * @param ns		long name length
+ * @param toggle	is long name from a toggle alias?
+ * @return		slot with the name (or the empty slot for it)
+ */
+static uint32_t poptItemProbe(const poptItemIndex ix, const poptItem items,
+		int aliases, const char * s, size_t ns, int toggle)
+	/*@*/
+{
+    uint32_t h0 = 0;
+    uint32_t h1 = 0;
+    uint32_t j;
+    int i;
+
+    poptJlu32lpair(s, ns, &h0, &h1);
+    for (j = h0 & ix->mask; (i = ix->slots[j]) >= 0; j = (j + 1) & ix->mask) {
+	const poptItem item = items + i;
+	size_t nt = 0;
+	const char * t = poptItemName(item, aliases, &nt);
+
+	if (aliases && toggle != (F_ISSET(&item->option, TOGGLE) ? 1 : 0))
+	    continue;
+	if (t != NULL && nt == ns && !memcmp(t, s, ns))
+	    break;
+    }
+    return j;
+}
+
+/**
+ * Return the last added alias or exec item with a long name.
+ * @param ix		item index
+ * @param items		alias or exec items
+ * @param aliases	alias (1) or exec (0) items?
+ * @param s		long name
+ * @param ns		long name length
+ * @param toggle	look for toggle aliases?
+ * @return		item number (or -1 if not found)
+ */
+static int poptItemLookup(/*@null@*/ const poptItemIndex ix,
+		const poptItem items, int aliases,
+		const char * s, size_t ns, int toggle)
+	/*@*/
+{
+    if (ix == NULL)
+	return -1;
+    return ix->slots[poptItemProbe(ix, items, aliases, s, ns, toggle)];
+}
+
+/**
+ * Add the last of an array of alias or exec items to an item index.
+ * @param con		context
+ * @retval *ixp		item index (created if NULL)
+ * @param items		alias or exec items
+ * @param nitems	no. of items
+ * @param aliases	alias (1) or exec (0) items?
+ * @return		0 on success, POPT_ERROR_MALLOC on failure
+ */
+static int poptItemIndexAdd(poptContext con, poptItemIndex * ixp,
+		const poptItem items, int nitems, int aliases)
+	/*@modifies con, *ixp @*/
+{
+    poptItemIndex ix = *ixp;
+    const poptItem item = items + nitems - 1;
+    const char * s;
+    size_t ns = 0;
+    uint32_t j;
+
+    if (ix == NULL) {
+	ix = (poptItemIndex) conKeepRealloc(con, NULL, 0, sizeof(*ix));
+	if (ix == NULL)
+	    return POPT_ERROR_MALLOC;
+	memset(ix, 0, sizeof(*ix));
+	ix->mask = 16 - 1;
+	ix->slots = (int *) conKeepRealloc(con, NULL, 0,
+			(ix->mask + 1) * sizeof(*ix->slots));
+	if (ix->slots == NULL) {
+	    ix = conKeepFree(con, ix);
+	    return POPT_ERROR_MALLOC;
+	}
+	memset(ix->slots, 0xff, (ix->mask + 1) * sizeof(*ix->slots));
+	memset(ix->shorts, 0xff, sizeof(ix->shorts));
+	*ixp = ix;
+    }
+
+    if (item->option.shortName)
+	ix->shorts[(unsigned char)item->option.shortName] = nitems - 1;
+    if ((s = poptItemName(item, aliases, &ns)) == NULL)
+	return 0;
+
+    /* Keep the load factor at or below 1/2. */
+    if (2U * (uint32_t)(ix->nnames + 1) > ix->mask + 1) {
+	int * oslots = ix->slots;
+	uint32_t omask = ix->mask;
+	int * nslots = (int *) conKeepRealloc(con, NULL, 0,
+			2 * (omask + 1) * sizeof(*nslots));
+
+	if (nslots == NULL)
+	    return POPT_ERROR_MALLOC;
+	memset(nslots, 0xff, 2 * (omask + 1) * sizeof(*nslots));
+	ix->slots = nslots;
+	ix->mask = 2 * omask + 1;
+	for (j = 0; j <= omask; j++) {
+	    const char * t;
+	    size_t nt = 0;
+	    int i;
+
+	    if ((i = oslots[j]) < 0)
+		continue;
+	    t = poptItemName(items + i, aliases, &nt);
+	    if (t == NULL)	/* XXX can't happen */
+		continue;
+	    ix->slots[poptItemProbe(ix, items, aliases, t, nt,
+			(F_ISSET(&items[i].option, TOGGLE) ? 1 : 0))] = i;
+	}
+	oslots = conKeepFree(con, oslots);
+    }
+
+    j = poptItemProbe(ix, items, aliases, s, ns,
+		(F_ISSET(&item->option, TOGGLE) ? 1 : 0));
+    if (ix->slots[j] < 0)
+	ix->nnames++;
+    ix->slots[j] = nitems - 1;
+    return 0;
+}
+
+static poptItemIndex poptItemIndexFree(poptContext con,
+		/*@only@*/ /*@null@*/ poptItemIndex ix)
+	/*@modifies ix @*/
+{
+    if (ix != NULL) {
+	ix->slots = conKeepFree(con, ix->slots);
+	ix = conKeepFree(con, ix);
+    }
+    return NULL;
+}
+
+/* Only one of longName, shortName should be set, not both. */
+static int handleExec(/*@special@*/ poptContext con,
+		/*@null@*/ const char * longName, char shortName)
+	/*@uses con->execs, con->numExecs, con->flags, con->doExec,
+		con->av, con->nav, con->ac @*/
+	/*@modifies con @*/
+{
+    int i;
+
+    if (con->execs == NULL || con->numExecs <= 0 || con->execIndex == NULL)
+	return 0;
+
+    /* The last exec added with the name wins. */
+    if (longName)
+	i = poptItemLookup(con->execIndex, con->execs, 0,
+			longName, strlen(longName), 0);
+    else
+	i = con->execIndex->shorts[(unsigned char)shortName];
+    if (i < 0) return 0;
+
+
+    if (con->flags & POPT_CONTEXT_NO_EXEC)
+	return 1;
+
+    if (con->doExec < 0) {
+	con->doExec = i;
+	return 1;
+    }
+
+    /* We already have an exec to do; remember this option for next
+       time 'round */
+    (void) poptAvAdd(con, NULL, i, (longName ? '\0' : shortName), NULL);
+
+    return 1;
+}
+
+/**
+ * Compare long option for equality, adjusting for POPT_ARGFLAG_TOGGLE.
+ * @param opt           option
+ * @param longName	arg option
+ * @param longNameLen	arg option length
+ * @return		does long option match?
+ */
+static int
+longOptionStrcmp(const struct poptOption * opt,
+		/*@null@*/ const char * longName, size_t longNameLen)
+	/*@*/
+{
+    const char * optLongName = opt->longName;
+    int rc;
+
+assert(optLongName && longName);	/* XXX can't heppen */
+    if (optLongName == NULL || longName == NULL)
+	return 0;
+
+    if (F_ISSET(opt, TOGGLE)) {
+	if (optLongName[0] == 'n' && optLongName[1] == 'o') {
+	    optLongName += sizeof("no") - 1;
+	    if (optLongName[0] == '-')
+		optLongName++;
+	}
+	if (longName[0] == 'n' && longName[1] == 'o') {
+	    longName += sizeof("no") - 1;
+	    longNameLen -= sizeof("no") - 1;
+	    if (longName[0] == '-') {
+		longName++;
+		longNameLen--;
+	    }
+	}
+    }
+    rc = (int)(strlen(optLongName) == longNameLen);
+    if (rc)
+	rc = (int)(strncmp(optLongName, longName, longNameLen) == 0);
     return rc;
 }
 
@@ -400,20 +1561,22 @@ static int handleAlias(/*@special@*/ poptContext con,
 	    return 0;
     }
 
-    if (con->aliases == NULL || con->numAliases <= 0)
+    if (con->aliases == NULL || con->numAliases <= 0 || con->aliasIndex == NULL)
 	return 0;
 
-    for (i = con->numAliases - 1; i >= 0; i--) {
-	item = con->aliases + i;
-	if (longName) {
-	    if (item->option.longName == NULL)
-		continue;
-	    if (!longOptionStrcmp(&item->option, longName, longNameLen))
-		continue;
-	} else if (shortName != item->option.shortName)
-	    continue;
-	break;
-    }
+    /* The last alias added with the name wins. */
+    if (longName) {
+	size_t np = poptTogglePrefix(longName, longNameLen);
+	int j;
+
+	i = poptItemLookup(con->aliasIndex, con->aliases, 1,
+			longName, longNameLen, 0);
+	j = poptItemLookup(con->aliasIndex, con->aliases, 1,
+			longName + np, longNameLen - np, 1);
+	if (j > i)
+	    i = j;
+    } else
+	i = con->aliasIndex->shorts[(unsigned char)shortName];
     if (i < 0) return 0;
 
     if ((con->os - con->optionStack + 1) == con->optionDepth)
@@ -426,14 +1589,14 @@ static int handleAlias(/*@special@*/ poptContext con,
     con->os->next = 0;
     con->os->stuffed = 0;
     con->os->nextArg = NULL;
+    con->os->nextArgOwned = 0;
     con->os->nextCharArg = NULL;
     con->os->currAlias = con->aliases + i;
     {	const char ** av;
 	int ac = con->os->currAlias->argc;
-	/* Append --foo=bar arg to alias argv array (if present). */
+	/* Append --foo=bar arg to (a copy of) the alias argv array. */
 	if (longName && nextArg != NULL && *nextArg != '\0') {
-	    av = (const char**) xmalloc((ac + 1 + 1) * sizeof(*av));
-assert(av);	/* XXX won't happen. */
+	    av = (const char**) conAlloc(con, (ac + 1 + 1) * sizeof(*av));
 	    if (av != NULL) {
 		for (i = 0; i < ac; i++) {
 		    av[i] = con->os->currAlias->argv[i];
@@ -444,11 +1607,16 @@ assert(av);	/* XXX won't happen. */
 		av = con->os->currAlias->argv;
 	} else
 	    av = con->os->currAlias->argv;
-	rc = poptDupArgv(ac, av, &con->os->argc, &con->os->argv);
-	if (av != NULL && av != con->os->currAlias->argv)
-	    free(av);
+	/* The alias argv strings last as long as the context. */
+	con->os->argc = ac;
+	con->os->argv = av;
+	rc = (av != NULL ? 0 : POPT_ERROR_NOARG);
     }
     con->os->argb = NULL;
+    if (rc) {
+	con->os->argv = NULL;
+	con->os--;
+    }
 
     return (rc ? rc : 1);
 }
@@ -508,8 +1676,10 @@ static int execCommand(poptContext con)
 	/*@globals internalState @*/
 	/*@modifies internalState @*/
 {
-    poptItem item = con->doExec;
+    poptItem item = con->execs + con->doExec;
     poptArgv argv = NULL;
+    poptArgv av = NULL;
+    int ac = 0;
     int argc = 0;
     int rc;
     int ec = POPT_ERROR_ERRNO;
@@ -522,10 +1692,16 @@ assert(item);	/*XXX can't happen*/
 	(!con->execAbsolute && strchr(item->argv[0], '/')))
 	    return POPT_ERROR_NOARG;
 
+    if (con->ac > 0 && (av = poptAvArgv(con, &ac)) == NULL)
+	return POPT_ERROR_MALLOC;
+
     argv = (poptArgv) xmalloc(sizeof(*argv) *
-			(6 + item->argc + con->numLeftovers + con->ac));
+			(6 + item->argc + con->numLeftovers + ac));
 assert(argv);	/* XXX can't happen */
-    if (argv == NULL) return POPT_ERROR_MALLOC;
+    if (argv == NULL) {
+	av = _free(av);
+	return POPT_ERROR_MALLOC;
+    }
 
     if (!strchr(item->argv[0], '/') && con->execPath != NULL) {
         char *s = (char*) xmalloc(strlen(con->execPath) + strlen(item->argv[0]) + sizeof("/"));
@@ -545,9 +1721,9 @@ assert(argv);	/* XXX can't happen */
 	argc += (item->argc - 1);
     }
 
-    if (con->av != NULL && con->ac > 0) {
-	memcpy(argv + argc, con->av, sizeof(*argv) * con->ac);
-	argc += con->ac;
+    if (av != NULL && ac > 0) {
+	memcpy(argv + argc, av, sizeof(*argv) * ac);
+	argc += ac;
     }
 
     if (con->leftovers != NULL && con->numLeftovers > 0) {
@@ -603,12 +1779,39 @@ exit:
             free((void *)argv[0]);
         free(argv);
     }
+    av = _free(av);
     return ec;
 }
 
 /*@observer@*/ /*@null@*/
 static const struct poptOption *
-findOption(const struct poptOption * opt,
+findEntry(poptContext con, int i,
+		/*@null@*/ /*@out@*/ poptCallbackType * callback,
+		/*@null@*/ /*@out@*/ const void ** callbackData)
+	/*@modifies con, *callback, *callbackData */
+{
+    poptTableEntry e;
+
+    if (i < 0)
+	return NULL;
+    e = con->table->entries + i;
+    con->calc = e->calc;
+
+/*@-modobserver -mods @*/
+    if (callback)
+	*callback = e->callback;
+    if (callbackData)
+/*@-observertrans -dependenttrans @*/
+	*callbackData = e->callbackData;
+/*@=observertrans =dependenttrans @*/
+/*@=modobserver =mods @*/
+
+    return e->opt;
+}
+
+/*@observer@*/ /*@null@*/
+static const struct poptOption *
+findOption(poptContext con,
 		/*@null@*/ const char * longName, size_t longNameLen,
 		char shortName,
 		/*@null@*/ /*@out@*/ poptCallbackType * callback,
@@ -616,67 +1819,24 @@ findOption(const struct poptOption * opt,
 		unsigned int argInfo)
 	/*@modifies *callback, *callbackData */
 {
-    const struct poptOption * cb = NULL;
-    poptArg cbarg;
-    cbarg.ptr = NULL;
+    poptCompiledTable t = con->table;
+    int i = -1;
 
     /* This happens when a single - is given */
     if (LF_ISSET(ONEDASH) && !shortName && (longName && *longName == '\0'))
 	shortName = '-';
 
-    for (; opt->longName || opt->shortName || opt->arg; opt++) {
-        poptArg arg;
-        arg.ptr = opt->arg;
-
-	switch (poptArgType(opt)) {
-	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
-	{   const struct poptOption * opt2;
-
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
-	    if (arg.ptr == NULL) continue;	/* XXX program error */
-	    opt2 = findOption(arg.opt, longName, longNameLen, shortName, callback,
-			      callbackData, argInfo);
-	    if (opt2 == NULL) continue;
-	    /* Sub-table data will be inheirited if no data yet. */
-/*@-observertrans -dependenttrans @*/
-	    if (callback && *callback
-	     && callbackData && *callbackData == NULL)
-		*callbackData = opt->descrip;
-/*@=observertrans =dependenttrans @*/
-	    return opt2;
-	}   /*@notreached@*/ /*@switchbreak@*/ break;
-	case POPT_ARG_CALLBACK:
-	    cb = opt;
-	    cbarg.ptr = opt->arg;
-	    continue;
-	    /*@notreached@*/ /*@switchbreak@*/ break;
-	default:
-	    /*@switchbreak@*/ break;
-	}
+    if (longName != NULL)
+	i = poptTableLong(t, longName, longNameLen, argInfo);
 
-	if (longName != NULL && opt->longName != NULL &&
-		   (!LF_ISSET(ONEDASH) || F_ISSET(opt, ONEDASH)) &&
-		   longOptionStrcmp(opt, longName, longNameLen))
-	{
-	    break;
-	} else if (shortName && shortName == opt->shortName) {
-	    break;
-	}
+    /* The first option in table order wins. */
+    if (shortName) {
+	int j = t->shorts[(unsigned char)shortName];
+	if (i < 0 || (j >= 0 && j < i))
+	    i = j;
     }
 
-    if (opt->longName == NULL && !opt->shortName)
-	return NULL;
-
-/*@-modobserver -mods @*/
-    if (callback)
-	*callback = (cb ? cbarg.cb : NULL);
-    if (callbackData)
-/*@-observertrans -dependenttrans @*/
-	*callbackData = (cb && !CBF_ISSET(cb, INC_DATA) ? cb->descrip : NULL);
-/*@=observertrans =dependenttrans @*/
-/*@=modobserver =mods @*/
-
-    return opt;
+    return findEntry(con, i, callback, callbackData);
 }
 
 static const char * findNextArg(/*@special@*/ poptContext con,
@@ -704,8 +1864,9 @@ static const char * findNextArg(/*@special@*/ poptContext con,
 		/*@innercontinue@*/ continue;
 	    arg = os->argv[i];
 	    if (delete_arg) {
-		if (os->argb == NULL) os->argb = PBM_ALLOC(os->argc);
-assert(os->argb);	/* XXX can't happen */
+		if (os->argb == NULL)
+		    os->argb = conCalloc(con, __PBM_IX(os->argc) + 1,
+				sizeof(__pbm_bits));
 		if (os->argb != NULL)
 		    PBM_SET(i, os->argb);
 	    }
@@ -717,6 +1878,40 @@ assert(os->argb);	/* XXX can't happen */
     return arg;
 }
 
+/**
+ * Find the compiled alias argv string that an argument points into.
+ * @param con		context
+ * @param s		argument
+ * @retval *itemp	alias item
+ * @retval *ip		alias argv index
+ * @retval *offp	argument offset in the alias argv string
+ * @return		compiled alias argv (NULL if not an alias argument)
+ */
+/*@null@*/
+static poptArgTemplate poptArgTemplateFind(poptContext con, const char * s,
+		/*@out@*/ poptItem * itemp, /*@out@*/ int * ip,
+		/*@out@*/ size_t * offp)
+	/*@modifies *itemp, *ip, *offp @*/
+{
+    poptItem item = con->os->currAlias;
+    poptArgTemplate tp;
+    int i;
+
+    if (item == NULL || con->aliasTemplates == NULL)
+	return NULL;
+    if ((tp = con->aliasTemplates[item - con->aliases]) == NULL)
+	return NULL;
+    for (i = 0; i < item->argc; i++) {
+	if (s >= item->argv[i] && s <= item->argv[i] + tp->lens[i]) {
+	    *itemp = item;
+	    *ip = i;
+	    *offp = (size_t) (s - item->argv[i]);
+	    return tp;
+	}
+    }
+    return NULL;
+}
+
 static /*@only@*/ /*@null@*/ const char *
 expandNextArg(/*@special@*/ poptContext con, const char * s)
 	/*@uses con->optionStack, con->os,
@@ -728,8 +1923,47 @@ expandNextArg(/*@special@*/ poptContext con, const char * s)
     size_t tn = strlen(s) + 1;
     char c;
 
-    te = t = (char*) xmalloc(tn);
-assert(t);	/* XXX can't happen */
+    poptArgTemplate tp;
+    poptItem item;
+    size_t off;
+    int i;
+
+    /* Substitute into an alias argument from its known "!#:+" slots. */
+    con->os->nextArgOwned = 0;
+    if ((tp = poptArgTemplateFind(con, s, &item, &i, &off)) != NULL) {
+	const size_t * sp = tp->slots + tp->first[i];
+	const size_t * se = tp->slots + tp->first[i + 1];
+	const char * p = s;
+	size_t na;
+
+	while (sp < se && *sp < off)
+	    sp++;
+	if (sp == se || (a = findNextArg(con, 1U, 1)) == NULL)
+	    return s;
+	na = strlen(a);
+	tn = tp->lens[i] - off + (size_t)(se - sp) * na
+		- (size_t)(se - sp) * (sizeof("!#:+") - 1) + 1;
+	if ((te = t = (char*) conAlloc(con, tn)) == NULL)
+	    return NULL;
+	for (; sp < se; sp++) {
+	    const char * q = item->argv[i] + *sp;
+	    memcpy(te, p, (size_t)(q - p));
+	    te += q - p;
+	    memcpy(te, a, na);
+	    te += na;
+	    p = q + sizeof("!#:+") - 1;
+	}
+	memcpy(te, p, tp->lens[i] - (size_t)(p - item->argv[i]) + 1);
+	con->os->nextArgOwned = 1;
+	return t;
+    }
+
+    /* Borrow the argument when nothing is substituted (and it lasts). */
+    if (strstr(s, "!#:+") == NULL && (con->arena != NULL || !con->os->stuffed))
+	return s;
+    con->os->nextArgOwned = 1;
+
+    te = t = (char*) conAlloc(con, tn);
     if (t == NULL) return NULL;
     *t = '\0';
     while ((c = *s++) != '\0') {
@@ -749,10 +1983,11 @@ assert(t);	/* XXX can't happen */
 	    }
 	    s += sizeof("#:+") - 1;
 
-	    tn += strlen(a);
 	    {   size_t pos = (size_t) (te - t);
-        t = (char*) xrealloc(t, tn);
-assert(t);	/* XXX can't happen */
+		size_t otn = tn;
+		tn += strlen(a);
+		t = (char*) (con->arena ? poptArenaRealloc(con->arena, t, otn, tn)
+				: xrealloc(t, tn));
 		if (t == NULL)
 		    return NULL;
 		te = stpcpy(t + pos, a);
@@ -766,7 +2001,7 @@ assert(t);	/* XXX can't happen */
     }
     *te++ = '\0';
     /* If the new string is longer than needed, shorten. */
-    if ((t + tn) > te) {
+    if ((t + tn) > te && con->arena == NULL) {
 /*@-usereleased@*/	/* XXX splint can't follow the pointers. */
     if ((te = (char*) xrealloc(t, (size_t)(te - t))) == NULL)
 	    free(t);
@@ -783,8 +2018,8 @@ static void poptStripArg(/*@special@*/ poptContext con, int which)
 {
 /*@-compdef -sizeoftype -usedef @*/
     if (con->arg_strip == NULL)
-	con->arg_strip = PBM_ALLOC(con->optionStack[0].argc);
-assert(con->arg_strip);		/* XXX can't happen */
+	con->arg_strip = conCalloc(con, __PBM_IX(con->optionStack[0].argc) + 1,
+				sizeof(__pbm_bits));
     if (con->arg_strip != NULL)
     PBM_SET(which, con->arg_strip);
     return;
@@ -797,140 +2032,996 @@ unsigned int _poptBitsN = _POPT_BITS_N;
 unsigned int _poptBitsM = _POPT_BITS_M;
 /*@unchecked@*/
 unsigned int _poptBitsK = _POPT_BITS_K;
+/*@unchecked@*/
+unsigned int _poptBitsFlags = 0;
+
+#define	_POPT_BITS_BLOCK	512U	/* bits in a block (one cache line) */
+#define	_POPT_BITS_BLOCKW	(_POPT_BITS_BLOCK / __PBM_NBITS)
+
+/** No. of bits (or 4 bit counters) in a block. */
+#define	POPT_BITS_BLOCKN(_flags)	\
+    (((_flags) & POPT_BITS_COUNTING) ? _POPT_BITS_BLOCK / 4 : _POPT_BITS_BLOCK)
+
+/* Odd multipliers that pick the bit for each hash in a block's words. */
+/*@unchecked@*/ /*@observer@*/
+static const uint32_t _poptBitsSalt[32] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    0xfbd4c09dU, 0x5659f377U, 0x91272283U, 0x272cfb91U,
+    0x9258d6afU, 0x92341019U, 0x75a483abU, 0xc2e133f5U,
+    0xb2575c6bU, 0x2bfc3773U, 0x3d80d633U, 0xf745da57U,
+    0x7a4fe2ddU, 0xd150054dU, 0xcd04e2abU, 0x69435cb7U,
+    0xf0652087U, 0x342b2613U, 0x1d25b677U, 0xda971213U,
+    0x467ef83bU, 0x8de2dd31U, 0x650975fdU, 0x19f463dfU,
+};
+
+/**
+ * Return the no. of words needed for M bits (or counters).
+ * @param M		no. of bits
+ * @param flags		bit set layout (POPT_BITS_*)
+ * @return		no. of words
+ */
+static size_t poptBitsNW(unsigned int M, unsigned int flags)
+	/*@*/
+{
+    if (flags & POPT_BITS_COUNTING)
+	return (size_t)__PCM_IX(M - 1) + 1;
+    return (size_t)__PBM_IX(M - 1) + 1;
+}
+
+/** No. of words in a bit set. */
+#define	POPT_BITS_NW(_bits)	poptBitsNW((_bits)->M, (_bits)->flags)
 
 /*@-sizeoftype@*/
+/**
+ * Allocate a zeroed bit set.
+ * @param N		estimated population
+ * @param M		no. of bits (counters if POPT_BITS_COUNTING)
+ * @param K		no. of bits set per string
+ * @param flags		bit set layout (POPT_BITS_*)
+ * @return		new bit set, NULL on failure
+ */
+/*@null@*/
+static poptBits poptBitsAlloc(unsigned int N, unsigned int M, unsigned int K,
+		unsigned int flags)
+	/*@*/
+{
+    poptBits bits = NULL;
+    unsigned int blockn = POPT_BITS_BLOCKN(flags);
+    size_t nb;
+
+    if (M == 0U || K == 0U || K > 32U || (flags & ~POPT_BITS_LAYOUT))
+	return NULL;
+    if (flags & POPT_BITS_BLOCKED) {
+	/* Whole blocks, each on its own cache line. */
+	if (M > ~0U - (blockn - 1))
+	    return NULL;
+	M += blockn - 1;
+	M -= M % blockn;
+    }
+    nb = offsetof(struct poptBits_s, bits)
+	+ poptBitsNW(M, flags) * sizeof(__pbm_bits);
+#if defined(HAVE_POSIX_MEMALIGN)
+    if (flags & POPT_BITS_BLOCKED) {
+	void * p = NULL;
+	if (posix_memalign(&p, _POPT_BITS_BLOCK / 8, nb) == 0 && p != NULL)
+	    bits = memset(p, 0, nb);
+    } else
+#endif
+    bits = calloc(1, nb);
+    if (bits == NULL)
+	return NULL;
+    bits->N = N;
+    bits->M = M;
+    bits->K = K;
+    bits->flags = flags;
+    bits->magic = POPT_BITS_MAGIC;
+    bits->version = POPT_BITS_VERSION;
+    bits->hash = POPT_BITS_HASH;
+    return bits;
+}
+
+/**
+ * Return ln(x), x > 0, without dragging in libm.
+ * @param x		argument
+ * @return		natural logarithm of x
+ */
+static double poptLn(double x)
+	/*@*/
+{
+    static const double ln2 = 0.69314718055994530942;
+    double y, y2, t;
+    double r = 0.0;
+    int e = 0;
+    int i;
+
+    /* x = 2^e * x, 1 <= x < 2, then ln(x) = 2 atanh((x - 1) / (x + 1)). */
+    while (x >= 2.0) { x /= 2.0; e++; }
+    while (x < 1.0) { x *= 2.0; e--; }
+    y = (x - 1.0) / (x + 1.0);
+    y2 = y * y;
+    for (t = y, i = 1; i < 40; t *= y2, i += 2)
+	r += t / i;
+    return 2.0 * r + e * ln2;
+}
+
+poptBits poptBitsCreate(unsigned int n, double fpr, unsigned int flags)
+{
+    static const double ln2 = 0.69314718055994530942;
+    double m;
+    unsigned int M;
+    unsigned int K;
+
+    if (!(fpr > 0.0 && fpr < 1.0))
+	return NULL;
+    if (n == 0U)
+	n = 1U;
+
+    /* m = -n ln(p) / ln(2)^2 bits, k = (m / n) ln(2) hashes. */
+    m = -(double)n * poptLn(fpr) / (ln2 * ln2);
+    if (m >= (double)(~0U - _POPT_BITS_BLOCK))
+	return NULL;
+    M = (unsigned int) m;
+    if ((double)M < m)
+	M++;
+    if (M < __PBM_NBITS)
+	M = __PBM_NBITS;
+    K = (unsigned int) (((double)M / n) * ln2 + 0.5);
+    if (K < 1U) K = 1U;
+    if (K > 32U) K = 32U;
+
+    return poptBitsAlloc(n, M, K, flags);
+}
+
 static int _poptBitsNew(/*@null@*/ poptBits *bitsp)
-	/*@globals _poptBitsN, _poptBitsM, _poptBitsK @*/
-	/*@modifies *bitsp, _poptBitsN, _poptBitsM, _poptBitsK @*/
+	/*@globals _poptBitsN, _poptBitsM, _poptBitsK, _poptBitsFlags @*/
+	/*@modifies *bitsp @*/
+{
+    if (bitsp == NULL)
+	return POPT_ERROR_NULLARG;
+
+    /* XXX handle negated initialization. */
+    if (*bitsp == NULL) {
+	unsigned int N = _poptBitsN;
+	unsigned int M = _poptBitsM;
+	unsigned int K = _poptBitsK;
+	if (N == 0U) {
+	    N = _POPT_BITS_N;
+	    M = _POPT_BITS_M;
+	}
+	if (M == 0U) M = (3 * N) / 2;
+	if (K == 0U || K > 32U) K = _POPT_BITS_K;
+	if ((*bitsp = poptBitsAlloc(N, M, K, _poptBitsFlags)) == NULL)
+	    return POPT_ERROR_MALLOC;
+    }
+/*@-nullstate@*/
+    return 0;
+/*@=nullstate@*/
+}
+
+#if defined(__GNUC__)
+#define	POPT_PREFETCH(_p)	__builtin_prefetch(_p)
+#else
+#define	POPT_PREFETCH(_p)
+#endif
+
+#define	POPT_BITS_BATCH	16	/* strings hashed ahead of their probes */
+
+/**
+ * Hash a string, and find (and prefetch) the words it probes.
+ * @param bits		bit set
+ * @param s		string
+ * @retval h		hash pair
+ * @retval ix		bit (or counter) indices, block's first word (blocked)
+ * @return		0 on success, POPT_ERROR_NULLARG on an empty string
+ */
+static int poptBitsProbe(poptBits bits, /*@null@*/ const char * s,
+		uint32_t * h, uint32_t * ix)
+	/*@modifies h, ix @*/
+{
+    size_t ns = (s ? strlen(s) : 0);
+    unsigned i;
+
+    if (ns == 0)
+	return POPT_ERROR_NULLARG;
+    h[0] = h[1] = 0;
+    poptJlu32lpair(s, ns, &h[0], &h[1]);
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	uint32_t blockn = POPT_BITS_BLOCKN(bits->flags);
+	uint64_t nblocks = bits->M / blockn;
+	uint32_t blk = (uint32_t)((h[0] * nblocks) >> 32);
+	POPT_PREFETCH(__PBM_BITS(bits) + (size_t)blk * _POPT_BITS_BLOCKW);
+	if (!(bits->flags & POPT_BITS_COUNTING)) {
+	    ix[0] = blk * _POPT_BITS_BLOCKW;
+	    return 0;
+	}
+	/* 7 bits: one of the block's 128 counters. */
+	for (i = 0; i < bits->K; i++)
+	    ix[i] = blk * blockn + ((h[1] * _poptBitsSalt[i]) >> 25);
+    } else
+    for (i = 0; i < bits->K; i++) {
+	ix[i] = (h[0] + i * h[1]) % bits->M;
+	POPT_PREFETCH(__PBM_BITS(bits) + ((bits->flags & POPT_BITS_COUNTING)
+		? __PCM_IX(ix[i]) : __PBM_IX(ix[i])));
+    }
+    return 0;
+}
+
+/**
+ * Compute the bits a hash pair sets within its block.
+ * @param bits		bit set
+ * @param h1		second hash
+ * @retval mask		bits to test within the block
+ */
+static void poptBitsMask(poptBits bits, uint32_t h1, __pbm_bits * mask)
+	/*@modifies mask @*/
+{
+    unsigned i;
+
+    memset(mask, 0, _POPT_BITS_BLOCKW * sizeof(*mask));
+    for (i = 0; i < bits->K && i < 32U; i++) {
+	uint32_t ix = (h1 * _poptBitsSalt[i]) >> 23;	/* 9 bits: 0 .. 511 */
+	mask[__PBM_IX(ix)] |= __PBM_MASK(ix);
+    }
+}
+
+/**
+ * Test whether all of a string's bits are set.
+ * @param bits		bit set
+ * @param h		hash pair
+ * @param ix		probes from poptBitsProbe()
+ * @return		1 if all set, 0 otherwise
+ */
+static int poptBitsTest(poptBits bits, const uint32_t * h, const uint32_t * ix)
+	/*@*/
+{
+    unsigned i;
+
+    if (bits->flags & POPT_BITS_COUNTING) {
+	for (i = 0; i < bits->K; i++) {
+	    if (PCM_GET(ix[i], bits) == 0)
+		return 0;
+	}
+	return 1;
+    }
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	__pbm_bits miss = 0;
+	poptBitsMask(bits, h[1], mask);
+	/* Test all the words at once, no branches. */
+	for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+	    miss |= mask[i] & ~__PBM_BITS(bits)[ix[0] + i];
+	return (miss == 0);
+    }
+
+    for (i = 0; i < bits->K; i++) {
+	if (!PBM_ISSET(ix[i], bits))
+	    return 0;
+    }
+    return 1;
+}
+
+/**
+ * Set (or clear) all of a string's bits.
+ *
+ * Counters are incremented (or decremented) instead, and stick once they
+ * saturate: a counter that has lost count can never again reach zero.
+ * A string whose counters are not all set is not decremented at all.
+ * @param bits		bit set
+ * @param h		hash pair
+ * @param ix		probes from poptBitsProbe()
+ * @param set		set (clear if 0)?
+ */
+static void poptBitsSet(poptBits bits, const uint32_t * h, const uint32_t * ix,
+		int set)
+	/*@modifies bits @*/
+{
+    unsigned i;
+
+    if (bits->flags & POPT_BITS_COUNTING) {
+	/* A string that isn't there has no counts of its own to take back. */
+	if (!set && !poptBitsTest(bits, h, ix))
+	    return;
+	for (i = 0; i < bits->K; i++) {
+	    unsigned c = PCM_GET(ix[i], bits);
+	    if (c == __PCM_MAX)
+		continue;
+	    if (set)
+		PCM_INC(ix[i], bits);
+	    else if (c > 0)
+		PCM_DEC(ix[i], bits);
+	}
+	return;
+    }
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	poptBitsMask(bits, h[1], mask);
+	for (i = 0; i < _POPT_BITS_BLOCKW; i++) {
+	    if (set)
+		__PBM_BITS(bits)[ix[0] + i] |= mask[i];
+	    else
+		__PBM_BITS(bits)[ix[0] + i] &= ~mask[i];
+	}
+	return;
+    }
+
+    for (i = 0; i < bits->K; i++) {
+	if (set)
+	    PBM_SET(ix[i], bits);
+	else
+	    PBM_CLR(ix[i], bits);
+    }
+}
+
+int poptBitsAdd(poptBits bits, const char * s)
+{
+    uint32_t h[2];
+    uint32_t ix[32];
+
+    if (bits == NULL || poptBitsProbe(bits, s, h, ix))
+	return POPT_ERROR_NULLARG;
+    if (bits->flags & POPT_BITS_MAPPED)
+	return POPT_ERROR_BADOPERATION;
+    poptBitsSet(bits, h, ix, 1);
+    return 0;
+}
+
+int poptBitsChk(poptBits bits, const char * s)
 {
-    if (bitsp == NULL)
+    uint32_t h[2];
+    uint32_t ix[32];
+
+    if (bits == NULL || poptBitsProbe(bits, s, h, ix))
 	return POPT_ERROR_NULLARG;
+    return poptBitsTest(bits, h, ix);
+}
 
-    /* XXX handle negated initialization. */
-    if (*bitsp == NULL) {
-	if (_poptBitsN == 0) {
-	    _poptBitsN = _POPT_BITS_N;
-	    _poptBitsM = _POPT_BITS_M;
+int poptBitsAddMany(poptBits bits, const char ** sv, size_t n)
+{
+    uint32_t h[POPT_BITS_BATCH][2];
+    uint32_t ix[POPT_BITS_BATCH][32];
+    size_t i, j, nb;
+
+    if (bits == NULL || (sv == NULL && n > 0))
+	return POPT_ERROR_NULLARG;
+    if (bits->flags & POPT_BITS_MAPPED)
+	return POPT_ERROR_BADOPERATION;
+
+    /* Hash (and prefetch) a batch of strings, then set their bits. */
+    for (i = 0; i < n; i += nb) {
+	nb = (n - i < POPT_BITS_BATCH ? n - i : POPT_BITS_BATCH);
+	for (j = 0; j < nb; j++) {
+	    if (poptBitsProbe(bits, sv[i+j], h[j], ix[j]))
+		return POPT_ERROR_NULLARG;
 	}
-	if (_poptBitsM == 0U) _poptBitsM = (3 * _poptBitsN) / 2;
-	if (_poptBitsK == 0U || _poptBitsK > 32U) _poptBitsK = _POPT_BITS_K;
-	*bitsp = PBM_ALLOC(_poptBitsM-1);
+	for (j = 0; j < nb; j++)
+	    poptBitsSet(bits, h[j], ix[j], 1);
     }
-/*@-nullstate@*/
     return 0;
-/*@=nullstate@*/
 }
 
-int poptBitsAdd(poptBits bits, const char * s)
+int poptBitsChkMany(poptBits bits, const char ** sv, size_t n, int * rcs)
 {
-    size_t ns = (s ? strlen(s) : 0);
-    uint32_t h0 = 0;
-    uint32_t h1 = 0;
+    uint32_t h[POPT_BITS_BATCH][2];
+    uint32_t ix[POPT_BITS_BATCH][32];
+    size_t i, j, nb;
+    int nhits = 0;
 
-    if (bits == NULL || ns == 0)
+    if (bits == NULL || (sv == NULL && n > 0))
 	return POPT_ERROR_NULLARG;
 
-    poptJlu32lpair(s, ns, &h0, &h1);
+    /* Hash (and prefetch) a batch of strings, then test their bits. */
+    for (i = 0; i < n; i += nb) {
+	nb = (n - i < POPT_BITS_BATCH ? n - i : POPT_BITS_BATCH);
+	for (j = 0; j < nb; j++) {
+	    if (poptBitsProbe(bits, sv[i+j], h[j], ix[j]))
+		return POPT_ERROR_NULLARG;
+	}
+	for (j = 0; j < nb; j++) {
+	    int rc = poptBitsTest(bits, h[j], ix[j]);
+	    if (rcs != NULL)
+		rcs[i+j] = rc;
+	    nhits += rc;
+	}
+    }
+    return nhits;
+}
+
+#if defined(__GNUC__)
+#define	POPT_ATOMIC_LOAD(_p)	__atomic_load_n((_p), __ATOMIC_RELAXED)
+#define	POPT_ATOMIC_OR(_p, _m)	(void) __atomic_fetch_or((_p), (_m), __ATOMIC_RELAXED)
+#define	POPT_ATOMIC_CAS(_p, _op, _n)	\
+    __atomic_compare_exchange_n((_p), (_op), (_n), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L \
+   && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define	POPT_ATOMIC_LOAD(_p)	\
+    atomic_load_explicit((_Atomic __pbm_bits *)(_p), memory_order_relaxed)
+#define	POPT_ATOMIC_OR(_p, _m)	(void) \
+    atomic_fetch_or_explicit((_Atomic __pbm_bits *)(_p), (_m), memory_order_relaxed)
+#define	POPT_ATOMIC_CAS(_p, _op, _n)	\
+    atomic_compare_exchange_weak_explicit((_Atomic __pbm_bits *)(_p), (_op), (_n), \
+		memory_order_relaxed, memory_order_relaxed)
+#else
+/* No atomics: refuse the *Atomic calls rather than race silently. */
+#define	POPT_BITS_NO_ATOMICS
+#endif
+
+#if !defined(POPT_BITS_NO_ATOMICS)
 
-    for (ns = 0; ns < (size_t)_poptBitsK; ns++) {
-        uint32_t h = h0 + ns * h1;
-        uint32_t ix = (h % _poptBitsM);
-        PBM_SET(ix, bits);
+/**
+ * Set (or increment) all of a string's bits, with atomic read-modify-writes.
+ * @param bits		bit set
+ * @param h		hash pair
+ * @param ix		probes from poptBitsProbe()
+ */
+static void poptBitsSetAtomic(poptBits bits, const uint32_t * h,
+		const uint32_t * ix)
+	/*@modifies bits @*/
+{
+    __pbm_bits * w = __PBM_BITS(bits);
+    unsigned i;
+
+    if (bits->flags & POPT_BITS_COUNTING) {
+	for (i = 0; i < bits->K; i++) {
+	    __pbm_bits * wp = w + __PCM_IX(ix[i]);
+	    unsigned shift = __PCM_SHIFT(ix[i]);
+	    __pbm_bits o = POPT_ATOMIC_LOAD(wp);
+	    /* Retry until no other thread changed the word underneath. */
+	    do {
+		if (((o >> shift) & __PCM_MAX) == __PCM_MAX)
+		    break;
+	    } while (!POPT_ATOMIC_CAS(wp, &o, o + ((__pbm_bits) 1 << shift)));
+	}
+	return;
     }
-    return 0;
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	poptBitsMask(bits, h[1], mask);
+	for (i = 0; i < _POPT_BITS_BLOCKW; i++) {
+	    if (mask[i])
+		POPT_ATOMIC_OR(w + ix[0] + i, mask[i]);
+	}
+	return;
+    }
+
+    for (i = 0; i < bits->K; i++)
+	POPT_ATOMIC_OR(w + __PBM_IX(ix[i]), __PBM_MASK(ix[i]));
 }
 
-int poptBitsChk(poptBits bits, const char * s)
+/**
+ * Test whether all of a string's bits are set, with relaxed atomic loads.
+ * @param bits		bit set
+ * @param h		hash pair
+ * @param ix		probes from poptBitsProbe()
+ * @return		1 if all set, 0 otherwise
+ */
+static int poptBitsTestAtomic(poptBits bits, const uint32_t * h,
+		const uint32_t * ix)
+	/*@*/
 {
-    size_t ns = (s ? strlen(s) : 0);
-    uint32_t h0 = 0;
-    uint32_t h1 = 0;
-    int rc = 1;
+    __pbm_bits * w = __PBM_BITS(bits);
+    unsigned i;
+
+    if (bits->flags & POPT_BITS_COUNTING) {
+	for (i = 0; i < bits->K; i++) {
+	    __pbm_bits x = POPT_ATOMIC_LOAD(w + __PCM_IX(ix[i]));
+	    if (((x >> __PCM_SHIFT(ix[i])) & __PCM_MAX) == 0)
+		return 0;
+	}
+	return 1;
+    }
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	__pbm_bits miss = 0;
+	poptBitsMask(bits, h[1], mask);
+	for (i = 0; i < _POPT_BITS_BLOCKW; i++) {
+	    if (mask[i])
+		miss |= mask[i] & ~POPT_ATOMIC_LOAD(w + ix[0] + i);
+	}
+	return (miss == 0);
+    }
+
+    for (i = 0; i < bits->K; i++) {
+	if (!(POPT_ATOMIC_LOAD(w + __PBM_IX(ix[i])) & __PBM_MASK(ix[i])))
+	    return 0;
+    }
+    return 1;
+}
+#endif
 
-    if (bits == NULL || ns == 0)
+int poptBitsAddAtomic(poptBits bits, const char * s)
+{
+    uint32_t h[2];
+    uint32_t ix[32];
+
+    if (bits == NULL || poptBitsProbe(bits, s, h, ix))
 	return POPT_ERROR_NULLARG;
+#if defined(POPT_BITS_NO_ATOMICS)
+    return POPT_ERROR_BADOPERATION;
+#else
+    if (bits->flags & POPT_BITS_MAPPED)
+	return POPT_ERROR_BADOPERATION;
+    poptBitsSetAtomic(bits, h, ix);
+    return 0;
+#endif
+}
 
-    poptJlu32lpair(s, ns, &h0, &h1);
+int poptBitsChkAtomic(poptBits bits, const char * s)
+{
+    uint32_t h[2];
+    uint32_t ix[32];
 
-    for (ns = 0; ns < (size_t)_poptBitsK; ns++) {
-        uint32_t h = h0 + ns * h1;
-        uint32_t ix = (h % _poptBitsM);
-        if (PBM_ISSET(ix, bits))
-            continue;
-        rc = 0;
-        break;
-    }
-    return rc;
+    if (bits == NULL || poptBitsProbe(bits, s, h, ix))
+	return POPT_ERROR_NULLARG;
+#if defined(POPT_BITS_NO_ATOMICS)
+    return POPT_ERROR_BADOPERATION;
+#else
+    return poptBitsTestAtomic(bits, h, ix);
+#endif
 }
 
 int poptBitsClr(poptBits bits)
 {
     static size_t nbw = (__PBM_NBITS/8);
-    size_t nw = (__PBM_IX(_poptBitsM-1) + 1);
 
     if (bits == NULL)
 	return POPT_ERROR_NULLARG;
-    memset(bits, 0, nw * nbw);
+    if (bits->flags & POPT_BITS_MAPPED)
+	return POPT_ERROR_BADOPERATION;
+    memset(__PBM_BITS(bits), 0, POPT_BITS_NW(bits) * nbw);
     return 0;
 }
 
 int poptBitsDel(poptBits bits, const char * s)
 {
-    size_t ns = (s ? strlen(s) : 0);
-    uint32_t h0 = 0;
-    uint32_t h1 = 0;
+    uint32_t h[2];
+    uint32_t ix[32];
 
-    if (bits == NULL || ns == 0)
+    if (bits == NULL || poptBitsProbe(bits, s, h, ix))
 	return POPT_ERROR_NULLARG;
+    if (bits->flags & POPT_BITS_MAPPED)
+	return POPT_ERROR_BADOPERATION;
+    poptBitsSet(bits, h, ix, 0);
+    return 0;
+}
 
-    poptJlu32lpair(s, ns, &h0, &h1);
+/**
+ * Prepare *ap to be combined with b, allocating it like b if NULL.
+ * @retval *ap		bit set
+ * @param b		bit set
+ * @return		0 on success, otherwise POPT_* error.
+ */
+static int poptBitsLike(/*@null@*/ poptBits *ap, /*@null@*/ const poptBits b)
+	/*@modifies *ap @*/
+{
+    if (ap == NULL || b == NULL)
+	return POPT_ERROR_NULLARG;
+    if (*ap == NULL
+     && (*ap = poptBitsAlloc(b->N, b->M, b->K, b->flags & POPT_BITS_LAYOUT)) == NULL)
+	return POPT_ERROR_MALLOC;
+    /* Only bit sets hashed the same way can be combined. */
+    if ((*ap)->M != b->M || (*ap)->K != b->K
+     || ((*ap)->flags & POPT_BITS_LAYOUT) != (b->flags & POPT_BITS_LAYOUT)
+     || ((*ap)->flags & POPT_BITS_MAPPED))
+	return POPT_ERROR_BADOPERATION;
+    return 0;
+}
 
-    for (ns = 0; ns < (size_t)_poptBitsK; ns++) {
-        uint32_t h = h0 + ns * h1;
-        uint32_t ix = (h % _poptBitsM);
-        PBM_CLR(ix, bits);
+/**
+ * Intersect (or union) b's words into a's, 128 or 64 bits at a time.
+ * @param a		words to update
+ * @param b		words to merge
+ * @param nw		no. of words
+ * @param intersect	intersect (union if 0)?
+ * @return		1 if any bits remain set in a, 0 otherwise
+ */
+static int poptBitsMerge(__pbm_bits * a, const __pbm_bits * b, size_t nw,
+		int intersect)
+	/*@modifies a @*/
+{
+    uint64_t rc = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    {	__m128i acc = _mm_setzero_si128();
+	for (; i + 4 <= nw; i += 4) {
+	    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+	    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+	    x = (intersect ? _mm_and_si128(x, y) : _mm_or_si128(x, y));
+	    _mm_storeu_si128((__m128i *)(a + i), x);
+	    acc = _mm_or_si128(acc, x);
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+	    rc = 1;
     }
-    return 0;
+#endif
+    for (; i + 2 <= nw; i += 2) {
+	uint64_t x, y;
+	memcpy(&x, a + i, sizeof(x));
+	memcpy(&y, b + i, sizeof(y));
+	x = (intersect ? (x & y) : (x | y));
+	memcpy(a + i, &x, sizeof(x));
+	rc |= x;
+    }
+    for (; i < nw; i++) {
+	a[i] = (intersect ? (a[i] & b[i]) : (a[i] | b[i]));
+	rc |= a[i];
+    }
+    return (rc ? 1 : 0);
 }
 
-int poptBitsIntersect(poptBits *ap, const poptBits b)
+/**
+ * Intersect (or union) b's counters into a's, taking the lesser (or the
+ * saturated sum) of each pair.
+ * @param a		words to update
+ * @param b		words to merge
+ * @param nw		no. of words
+ * @param intersect	intersect (union if 0)?
+ * @return		1 if any counters remain non-zero in a, 0 otherwise
+ */
+static int poptBitsMergeCounters(__pbm_bits * a, const __pbm_bits * b,
+		size_t nw, int intersect)
+	/*@modifies a @*/
 {
-    __pbm_bits *abits;
-    __pbm_bits *bbits;
     __pbm_bits rc = 0;
-    size_t nw = (__PBM_IX(_poptBitsM-1) + 1);
     size_t i;
 
-    if (ap == NULL || b == NULL || _poptBitsNew(ap))
-	return POPT_ERROR_NULLARG;
-    abits = __PBM_BITS(*ap);
-    bbits = __PBM_BITS(b);
-
     for (i = 0; i < nw; i++) {
-        abits[i] &= bbits[i];
-	rc |= abits[i];
+	__pbm_bits x = 0;
+	unsigned j;
+	for (j = 0; j < __PCM_NCTRS; j++) {
+	    unsigned s = j * 4;
+	    unsigned u = (a[i] >> s) & __PCM_MAX;
+	    unsigned v = (b[i] >> s) & __PCM_MAX;
+	    if (intersect)
+		u = (u < v ? u : v);
+	    else if (u == __PCM_MAX || v == __PCM_MAX || (u += v) > __PCM_MAX)
+		u = __PCM_MAX;
+	    x |= (__pbm_bits) u << s;
+	}
+	a[i] = x;
+	rc |= x;
     }
     return (rc ? 1 : 0);
 }
 
+int poptBitsIntersect(poptBits *ap, const poptBits b)
+{
+    int rc;
+
+    if ((rc = poptBitsLike(ap, b)) != 0)
+	return rc;
+    if (b->flags & POPT_BITS_COUNTING)
+	return poptBitsMergeCounters(__PBM_BITS(*ap), __PBM_BITS(b),
+		POPT_BITS_NW(b), 1);
+    return poptBitsMerge(__PBM_BITS(*ap), __PBM_BITS(b), POPT_BITS_NW(b), 1);
+}
+
 int poptBitsUnion(poptBits *ap, const poptBits b)
 {
-    __pbm_bits *abits;
-    __pbm_bits *bbits;
-    __pbm_bits rc = 0;
-    size_t nw = (__PBM_IX(_poptBitsM-1) + 1);
-    size_t i;
+    int rc;
+
+    if ((rc = poptBitsLike(ap, b)) != 0)
+	return rc;
+    if (b->flags & POPT_BITS_COUNTING)
+	return poptBitsMergeCounters(__PBM_BITS(*ap), __PBM_BITS(b),
+		POPT_BITS_NW(b), 0);
+    return poptBitsMerge(__PBM_BITS(*ap), __PBM_BITS(b), POPT_BITS_NW(b), 0);
+}
+
+unsigned int poptBitsPopcount(poptBits bits)
+{
+    const __pbm_bits * w;
+    unsigned int n = 0;
+    int counting;
+    size_t nw;
+    size_t i = 0;
+
+    if (bits == NULL)
+	return 0;
+    w = __PBM_BITS(bits);
+    nw = POPT_BITS_NW(bits);
+    counting = (bits->flags & POPT_BITS_COUNTING);
+
+    for (; i + 2 <= nw; i += 2) {
+	uint64_t x;
+	memcpy(&x, w + i, sizeof(x));
+	if (counting) {
+	    /* One bit for each non-zero counter. */
+	    x |= x >> 1;
+	    x |= x >> 2;
+	    x &= 0x1111111111111111ULL;
+	}
+#if defined(__GNUC__)
+	n += (unsigned int) __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	n += (unsigned int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+    for (; i < nw; i++) {
+	__pbm_bits x = w[i];
+	if (counting) {
+	    x |= x >> 1;
+	    x |= x >> 2;
+	    x &= 0x11111111U;
+	}
+	for (; x != 0; x &= x - 1)
+	    n++;
+    }
+    return n;
+}
+
+double poptBitsEstimateCount(poptBits bits)
+{
+    double M;
+    double X;
+
+    if (bits == NULL)
+	return -1.0;
+    M = (double) bits->M;
+    X = (double) poptBitsPopcount(bits);
+    if (X >= M)
+	return HUGE_VAL;
+    /* n = -(M / K) ln(1 - X / M) */
+    return -(M / (double) bits->K) * poptLn(1.0 - X / M);
+}
+
+/** No. of bytes in a bit set header. */
+#define	POPT_BITS_HDRSIZE	offsetof(struct poptBits_s, bits)
+
+/**
+ * Return the no. of bytes in a bit set, header included.
+ * @param bits		bit set
+ * @return		no. of bytes
+ */
+static size_t poptBitsSize(poptBits bits)
+	/*@*/
+{
+    return POPT_BITS_HDRSIZE + POPT_BITS_NW(bits) * sizeof(__pbm_bits);
+}
 
-    if (ap == NULL || b == NULL || _poptBitsNew(ap))
+/**
+ * Check that a saved bit set header describes a set this code can use.
+ * @param bits		bit set header
+ * @param nb		no. of bytes in the file
+ * @return		0 if usable, POPT_ERROR_BADBITS otherwise
+ */
+static int poptBitsValid(poptBits bits, off_t nb)
+	/*@*/
+{
+    if (bits->magic != POPT_BITS_MAGIC
+     || bits->version != POPT_BITS_VERSION
+     || bits->hash != POPT_BITS_HASH
+     || bits->M == 0U || bits->K == 0U || bits->K > 32U
+     || (bits->flags & ~POPT_BITS_LAYOUT)
+     || ((bits->flags & POPT_BITS_BLOCKED)
+	 && (bits->M % POPT_BITS_BLOCKN(bits->flags)))
+     || (off_t) poptBitsSize(bits) != nb)
+	return POPT_ERROR_BADBITS;
+    return 0;
+}
+
+/**
+ * Write a buffer, resuming after short writes.
+ * @param fdno		file descriptor
+ * @param b		buffer
+ * @param nb		no. of bytes
+ * @return		0 on success, -1 on error
+ */
+static int poptWriteAll(int fdno, const void * b, size_t nb)
+	/*@globals errno, fileSystem @*/
+	/*@modifies errno, fileSystem @*/
+{
+    const char * s = b;
+
+    while (nb > 0) {
+	ssize_t xx = write(fdno, s, nb);
+	if (xx < 0 && errno == EINTR)
+	    continue;
+	if (xx <= 0)
+	    return -1;
+	s += xx;
+	nb -= (size_t) xx;
+    }
+    return 0;
+}
+
+/**
+ * Read a buffer, resuming after short reads.
+ * @param fdno		file descriptor
+ * @param b		buffer
+ * @param nb		no. of bytes
+ * @return		no. of bytes read (less than nb at EOF), -1 on error
+ */
+static ssize_t poptReadAll(int fdno, void * b, size_t nb)
+	/*@globals errno, fileSystem @*/
+	/*@modifies *b, errno, fileSystem @*/
+{
+    char * t = b;
+    size_t nr = 0;
+
+    while (nr < nb) {
+	ssize_t xx = read(fdno, t + nr, nb - nr);
+	if (xx < 0 && errno == EINTR)
+	    continue;
+	if (xx < 0)
+	    return -1;
+	if (xx == 0)
+	    break;
+	nr += (size_t) xx;
+    }
+    return (ssize_t) nr;
+}
+
+int poptBitsSave(poptBits bits, const char * fn)
+{
+    struct poptBits_s hdr;
+    char * tfn;
+    int fdno;
+    int rc = POPT_ERROR_ERRNO;	/* assume failure */
+
+    if (bits == NULL || fn == NULL)
 	return POPT_ERROR_NULLARG;
-    abits = __PBM_BITS(*ap);
-    bbits = __PBM_BITS(b);
 
-    for (i = 0; i < nw; i++) {
-        abits[i] |= bbits[i];
-	rc |= abits[i];
+    memcpy(&hdr, bits, POPT_BITS_HDRSIZE);
+    hdr.flags &= POPT_BITS_LAYOUT;
+
+    /* Write a new file and rename it, so readers never see a partial set. */
+    tfn = (char *) xmalloc(strlen(fn) + sizeof(".tmp") + 3 * sizeof(int));
+    if (tfn == NULL)
+	return POPT_ERROR_MALLOC;
+    (void) sprintf(tfn, "%s.tmp%d", fn, (int) getpid());
+    fdno = open(tfn, O_WRONLY|O_CREAT|O_EXCL|O_BINARY, 0644);
+    if (fdno < 0)
+	goto exit;
+    if (poptWriteAll(fdno, &hdr, POPT_BITS_HDRSIZE)
+     || poptWriteAll(fdno, __PBM_BITS(bits), poptBitsSize(bits) - POPT_BITS_HDRSIZE)
+     || close(fdno) == -1)
+    {
+	int oerrno = errno;
+	(void) close(fdno);
+	(void) unlink(tfn);
+	errno = oerrno;
+	goto exit;
     }
-    return (rc ? 1 : 0);
+#if defined(_WIN32)
+    /* rename(2) there won't replace an existing file. */
+    (void) unlink(fn);
+#endif
+    if (rename(tfn, fn) == -1) {
+	int oerrno = errno;
+	(void) unlink(tfn);
+	errno = oerrno;
+	goto exit;
+    }
+    rc = 0;
+
+exit:
+    tfn = _free(tfn);
+    return rc;
+}
+
+int poptBitsLoad(poptBits * bitsp, const char * fn)
+{
+    struct poptBits_s hdr;
+    poptBits bits = NULL;
+    size_t nb;
+    off_t fnb;
+    int fdno;
+    int rc = POPT_ERROR_ERRNO;	/* assume failure */
+
+    if (bitsp == NULL || fn == NULL)
+	return POPT_ERROR_NULLARG;
+
+    fdno = open(fn, O_RDONLY|O_BINARY);
+    if (fdno < 0)
+	return rc;
+    if ((fnb = lseek(fdno, 0, SEEK_END)) == (off_t)-1
+     || lseek(fdno, 0, SEEK_SET) == (off_t)-1)
+	goto exit;
+    if (fnb < (off_t) POPT_BITS_HDRSIZE
+     || poptReadAll(fdno, &hdr, POPT_BITS_HDRSIZE) != (ssize_t) POPT_BITS_HDRSIZE
+     || (rc = poptBitsValid(&hdr, fnb)) != 0)
+    {
+	rc = POPT_ERROR_BADBITS;
+	goto exit;
+    }
+    if ((bits = poptBitsAlloc(hdr.N, hdr.M, hdr.K, hdr.flags)) == NULL) {
+	rc = POPT_ERROR_MALLOC;
+	goto exit;
+    }
+    nb = poptBitsSize(bits) - POPT_BITS_HDRSIZE;
+    if (poptReadAll(fdno, __PBM_BITS(bits), nb) != (ssize_t) nb) {
+	rc = POPT_ERROR_BADBITS;
+	goto exit;
+    }
+    *bitsp = bits;
+    bits = NULL;
+    rc = 0;
+
+exit:
+    {	int oerrno = errno;
+	(void) close(fdno);
+	errno = oerrno;
+    }
+    bits = poptBitsFree(bits);
+    return rc;
+}
+
+int poptBitsMap(poptBits * bitsp, const char * fn)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    poptBits bits;
+    void * p;
+    off_t fnb;
+    int fdno;
+    int rc;
+
+    if (bitsp == NULL || fn == NULL)
+	return POPT_ERROR_NULLARG;
+
+    fdno = open(fn, O_RDONLY|O_BINARY);
+    if (fdno < 0)
+	return POPT_ERROR_ERRNO;
+    if ((fnb = lseek(fdno, 0, SEEK_END)) == (off_t)-1) {
+	int oerrno = errno;
+	(void) close(fdno);
+	errno = oerrno;
+	return POPT_ERROR_ERRNO;
+    }
+    if (fnb < (off_t) POPT_BITS_HDRSIZE) {
+	(void) close(fdno);
+	return POPT_ERROR_BADBITS;
+    }
+    p = mmap(NULL, (size_t) fnb, PROT_READ, MAP_PRIVATE, fdno, 0);
+    (void) close(fdno);
+    if (p == MAP_FAILED)
+	return POPT_ERROR_ERRNO;
+    bits = p;
+
+    if ((rc = poptBitsValid(bits, fnb)) != 0) {
+	(void) munmap(p, (size_t) fnb);
+	return rc;
+    }
+
+    /* Mark the set mapped: only the header page is copied on write. */
+    if (mprotect(p, POPT_BITS_HDRSIZE, PROT_READ|PROT_WRITE) == -1) {
+	int oerrno = errno;
+	(void) munmap(p, (size_t) fnb);
+	errno = oerrno;
+	return POPT_ERROR_ERRNO;
+    }
+    bits->flags |= POPT_BITS_MAPPED;
+    (void) mprotect(p, POPT_BITS_HDRSIZE, PROT_READ);
+
+    *bitsp = bits;
+    return 0;
+#else
+    return poptBitsLoad(bitsp, fn);
+#endif
+}
+
+poptBits poptBitsFree(poptBits bits)
+{
+    if (bits == NULL)
+	return NULL;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if (bits->flags & POPT_BITS_MAPPED) {
+	(void) munmap((void *)bits, poptBitsSize(bits));
+	return NULL;
+    }
+#endif
+    free(bits);
+    return NULL;
 }
 
 int poptBitsArgs(poptContext con, poptBits *ap)
@@ -945,10 +3036,8 @@ int poptBitsArgs(poptContext con, poptBits *ap)
     /* some apps like [like RPM ;-) ] need this NULL terminated */
     con->leftovers[con->numLeftovers] = NULL;
 
-    for (av = con->leftovers + con->nextLeftover; *av != NULL; av++) {
-	if ((rc = poptBitsAdd(*ap, *av)) != 0)
-	    break;
-    }
+    av = con->leftovers + con->nextLeftover;
+    rc = poptBitsAddMany(*ap, av, (size_t)(con->numLeftovers - con->nextLeftover));
 /*@-nullstate@*/
     return rc;
 /*@=nullstate@*/
@@ -957,16 +3046,26 @@ int poptBitsArgs(poptContext con, poptBits *ap)
 int poptSaveBits(poptBits * bitsp,
 		/*@unused@*/ UNUSED(unsigned int argInfo), const char * s)
 {
+    const char ** av = NULL;
+    size_t ac = 0;
     char *tbuf = NULL;
     char *t, *te;
     int rc = 0;
 
-    if (bitsp == NULL || s == NULL || *s == '\0' || _poptBitsNew(bitsp))
+    if (bitsp == NULL || s == NULL || *s == '\0')
 	return POPT_ERROR_NULLARG;
+    if ((rc = _poptBitsNew(bitsp)) != 0)
+	return rc;
 
-    /* Parse comma separated attributes. */
+    /* Parse comma separated attributes, adding them a batch at a time. */
     te = tbuf = xstrdup(s);
-    assert(te);
+    av = (const char **) xmalloc((strlen(s) / 2 + 1) * sizeof(*av));
+    assert(te && av);	/* XXX can't happen */
+    if (te == NULL || av == NULL) {
+	tbuf = _free(tbuf);
+	av = _free(av);
+	return POPT_ERROR_MALLOC;
+    }
     while ((t = te) != NULL && *t) {
 	while (*te != '\0' && *te != ',')
 	    te++;
@@ -975,66 +3074,274 @@ int poptSaveBits(poptBits * bitsp,
 	/* XXX Ignore empty strings. */
 	if (*t == '\0')
 	    continue;
-	/* XXX Permit negated attributes. caveat emptor: false negatives. */
+	/* XXX Permit negated attributes. caveat emptor: false negatives,
+	 * unless the set is POPT_BITS_COUNTING. */
 	if (*t == '!') {
+	    /* Add what precedes the negation first. */
+	    if ((rc = poptBitsAddMany(*bitsp, av, ac)) != 0)
+		break;
+	    ac = 0;
 	    t++;
 	    if ((rc = poptBitsChk(*bitsp, t)) > 0)
 		rc = poptBitsDel(*bitsp, t);
+	    if (rc)
+		break;
 	} else
-	    rc = poptBitsAdd(*bitsp, t);
-	if (rc)
-	    break;
+	    av[ac++] = t;
     }
+    if (rc == 0)
+	rc = poptBitsAddMany(*bitsp, av, ac);
+    av = _free(av);
     tbuf = _free(tbuf);
     return rc;
 }
-/*@=sizeoftype@*/
+/*@=sizeoftype@*/
+
+int poptSaveString(const char *** argvp,
+		/*@unused@*/ UNUSED(unsigned int argInfo), const char * val)
+{
+    int argc = 0;
+
+    if (argvp == NULL || val == NULL)
+	return POPT_ERROR_NULLARG;
+
+    /* XXX likely needs an upper bound on argc. */
+    if (*argvp != NULL)
+    while ((*argvp)[argc] != NULL)
+	argc++;
+
+/*@-unqualifiedtrans -nullstate@*/	/* XXX no annotation for (*argvp) */
+    if ((*argvp = (const char**) xrealloc(*argvp, (argc + 1 + 1) * sizeof(**argvp))) != NULL) {
+	(*argvp)[argc++] = xstrdup(val);
+	(*argvp)[argc  ] = NULL;
+    }
+    return 0;
+/*@=unqualifiedtrans =nullstate@*/
+}
+
+int poptSaveCountedArgv(const char *** argvp,
+		/*@unused@*/ UNUSED(unsigned int argInfo), const char * val)
+{
+    poptArgvHdr h;
+
+    if (argvp == NULL || val == NULL)
+	return POPT_ERROR_NULLARG;
+
+    h = (*argvp != NULL ? POPT_ARGV_HDR(*argvp) : NULL);
+    if (h == NULL || h->count + 1 == h->alloced) {
+	size_t alloced = (h != NULL ? 2 * h->alloced : 8);
+	h = (poptArgvHdr) xrealloc(h, sizeof(*h) + alloced * sizeof(**argvp));
+	if (h == NULL)
+	    return POPT_ERROR_MALLOC;
+	if (*argvp == NULL)
+	    h->count = 0;
+	h->alloced = alloced;
+	*argvp = (const char **) (h + 1);
+    }
+    if (((*argvp)[h->count] = xstrdup(val)) == NULL)
+	return POPT_ERROR_MALLOC;
+    (*argvp)[++h->count] = NULL;
+    return 0;
+}
+
+int poptArgvCount(const char ** argv)
+{
+    return (argv != NULL ? (int) POPT_ARGV_HDR(argv)->count : 0);
+}
+
+const char ** poptFreeArgv(const char ** argv)
+{
+    if (argv != NULL) {
+	poptArgvHdr h = POPT_ARGV_HDR(argv);
+	size_t i;
+	for (i = 0; i < h->count; i++)
+	    argv[i] = _free(argv[i]);
+	h = _free(h);
+    }
+    return NULL;
+}
 
-int poptSaveString(const char *** argvp,
-		/*@unused@*/ UNUSED(unsigned int argInfo), const char * val)
+/**
+ * Append a string to a POPT_ARG_ARGV array, remembering its size.
+ * Repeating options n times is O(n) rather than poptSaveString()'s
+ * O(n^2): each array appended to is neither recounted nor reallocated
+ * until its (doubling) capacity is used up, however the options that
+ * append to different arrays are interleaved.
+ * @param con		context
+ * @param argvp		address of the argv array
+ * @param val		string to append
+ * @return		0 on success, POPT_ERROR_* on failure
+ */
+static int poptSaveArgvString(poptContext con, const char *** argvp,
+		const char * val)
+	/*@modifies con, *argvp @*/
 {
+    const char ** argv;
+    poptArgvSave save = NULL;
     int argc = 0;
+    int alloced = 0;
+    size_t i;
 
     if (argvp == NULL || val == NULL)
 	return POPT_ERROR_NULLARG;
 
-    /* XXX likely needs an upper bound on argc. */
-    if (*argvp != NULL)
-    while ((*argvp)[argc] != NULL)
-	argc++;
+    /* There are only as many arrays as POPT_ARG_ARGV options. */
+    for (i = 0; i < con->nsaves; i++) {
+	if (con->saves[i].argvp == argvp) {
+	    save = con->saves + i;
+	    break;
+	}
+    }
+    if (save == NULL) {
+	if (con->nsaves == con->maxsaves) {
+	    size_t n = (con->maxsaves > 0 ? 2 * con->maxsaves : 4);
+	    poptArgvSave saves = (poptArgvSave) conKeepRealloc(con, con->saves,
+			con->maxsaves * sizeof(*saves), n * sizeof(*saves));
+	    if (saves == NULL)
+		return POPT_ERROR_MALLOC;
+	    con->saves = saves;
+	    con->maxsaves = n;
+	}
+	save = con->saves + con->nsaves++;
+	save->argvp = argvp;
+	save->argv = NULL;
+    }
 
-/*@-unqualifiedtrans -nullstate@*/	/* XXX no annotation for (*argvp) */
-    if ((*argvp = (const char**) xrealloc(*argvp, (argc + 1 + 1) * sizeof(**argvp))) != NULL) {
-	(*argvp)[argc++] = xstrdup(val);
-	(*argvp)[argc  ] = NULL;
+    /* Trust the remembered size only if the array is untouched since. */
+    if (*argvp != NULL && *argvp == save->argv
+     && (*argvp)[save->argc] == NULL)
+    {
+	argc = save->argc;
+	alloced = save->alloced;
+    } else if (*argvp != NULL) {
+	while ((*argvp)[argc] != NULL)
+	    argc++;
+	alloced = argc + 1;
     }
+
+    if (argc + 1 + 1 > alloced) {
+	alloced = (alloced < 8 ? 8 : 2 * alloced);
+	argv = (const char **) xrealloc(*argvp, alloced * sizeof(*argv));
+	if (argv == NULL)
+	    return POPT_ERROR_MALLOC;
+	*argvp = argv;
+    }
+    if (((*argvp)[argc] = xstrdup(val)) == NULL)
+	return POPT_ERROR_MALLOC;
+    (*argvp)[++argc] = NULL;
+
+    save->argv = *argvp;
+    save->argc = argc;
+    save->alloced = alloced;
     return 0;
-/*@=unqualifiedtrans =nullstate@*/
 }
 
 /*@unchecked@*/
 static unsigned seed = 0;
 
-typedef int64_t * poptStack_t;
+/**
+ * Evaluate a compiled calculator on the context's calculator stack.
+ * The stack carries over from the previous evaluation while options save
+ * to the same variable, and the variable still holds the top of the stack.
+ * @param con		context
+ * @param calc		compiled calculator
+ * @param target	variable the result will be saved to
+ * @param arg0		current value
+ * @param arg1		option value
+ * @retval *rcp		0 on success, otherwise POPT_ERROR_*
+ * @return		value on top of the stack
+ */
+static long long poptCalcEval(poptContext con, poptCalc calc,
+		/*@null@*/ const void * target, long long arg0, long long arg1,
+		int * rcp)
+	/*@modifies con, *rcp @*/
+{
+    poptCalcInsn i = calc->insns;
+    poptCalcInsn ie = i + calc->ninsns;
+    long long * stk = con->calcStack;
+    int ix = (int) (con->stk - stk);
+
+    if ((*rcp = calc->rc) != 0)
+	return 0;
+
+    /* Start a new computation, or continue with the last result. */
+    if (!(target == con->calcArg && ix > 0 && stk[ix-1] == arg0)) {
+	ix = 0;
+	stk[ix++] = arg0;
+    }
+    if (ix - 1 < calc->need) {
+	*rcp = POPT_ERROR_STACKUNDERFLOW;
+	goto exit;
+    }
+    /* Make room by dropping the oldest values, out of this expression's reach. */
+    if (ix + 1 + calc->peak > (int) con->calcDepth && ix - 1 > calc->need) {
+	int ndrop = ix + 1 + calc->peak - (int) con->calcDepth;
+	if (ndrop > ix - 1 - calc->need)
+	    ndrop = ix - 1 - calc->need;
+	memmove(stk, stk + ndrop, (ix - ndrop) * sizeof(*stk));
+	ix -= ndrop;
+    }
+    if (ix + 1 + calc->peak > (int) con->calcDepth) {
+	*rcp = POPT_ERROR_STACKOVERFLOW;
+	goto exit;
+    }
+    stk[ix++] = arg1;
+
+    for (; i < ie; i++) {
+	if (i->op == 0) {
+	    stk[ix++] = i->val;
+	    continue;
+	}
+	ix--;
+	switch (i->op) {
+	case 'd':		/* duplicate */
+	    ix++;
+	    stk[ix] = stk[ix-1];
+	    ix++;
+	    break;
+	case 'P':		/* pop */
+	    break;
+	case 'r':		/* reverse */
+	    ix++;
+	    stk[ix] = stk[ix-2];
+	    stk[ix-2] = stk[ix-1];
+	    stk[ix-1] = stk[ix];
+	    break;
+	case '=':	stk[ix-1]  = stk[ix];	break;
+	case '|':	stk[ix-1] |= stk[ix];	break;
+	case '&':	stk[ix-1] &= stk[ix];	break;
+	case '^':	stk[ix-1] ^= stk[ix];	break;
+	case '+':	stk[ix-1] += stk[ix];	break;
+	case '-':	stk[ix-1] -= stk[ix];	break;
+	case '*':	stk[ix-1] *= stk[ix];	break;
+	case '/':
+	case '%':
+	    if (stk[ix] == 0) {
+		*rcp = POPT_ERROR_BADOPERATION; /* XXX POPT_ERROR_DIVZERO */
+		ix = 0;
+		goto exit;
+	    }
+	    if (i->op == (int)'%')
+		stk[ix-1] %= stk[ix];
+	    else
+		stk[ix-1] /= stk[ix];
+	    break;
+	}
+    }
+
+exit:
+    con->stk = stk + ix;
+    con->calcArg = (*rcp == 0 ? target : NULL);
+    return (*rcp == 0 ? stk[ix-1] : 0);
+}
 
-static long long poptCalculator(long long arg0, unsigned argInfo, long long arg1,
-		/*@null@*/ const char * expr, int * rcp)
+static long long poptCalculator(/*@null@*/ poptContext con,
+		/*@null@*/ const void * target,
+		long long arg0, unsigned argInfo, long long arg1,
+		/*@null@*/ poptCalc calc, int * rcp)
 {
-int ixmax = 20;	/* XXX overkill */
-poptStack_t stk = (poptStack_t) memset((poptStack_t)alloca(ixmax*sizeof(*stk)), 0, (ixmax*sizeof(*stk)));
-    int ix = 0;
-size_t nt = 64;	/* XXX overkill */
-char * t = (char*) alloca(nt);
-char * te = t;
-const char * s;
     int rc = 0;		/* assume success */
     long long retval = 0;
-    int i;
-const char ** av = NULL;
-int ac = 0;
-int xx;
-
-    stk[ix++] = arg0;
 
     if (arg1 != 0 && LF_ISSET(RANDOM)) {
 #if defined(HAVE_SRANDOM)
@@ -1053,110 +3360,32 @@ int xx;
     if (!LF_ISSET(CALCULATOR) && LF_ISSET(NOT))
 	arg1 = ~arg1;
 
-    stk[ix++] = arg1;
+    /* A compiled calculator runs on the context's calculator stack. */
+    if (calc != NULL) {
+	if (con != NULL)
+	    retval = poptCalcEval(con, calc, target, arg0, arg1, &rc);
+	goto exit;
+    }
 
-    /* XXX hotwire a RPN program. */
-    if (expr == NULL) {
+    /* The implicit operator is applied directly. */
     switch (LF_ISSET(LOGICALOPS)) {
-	case POPT_ARGFLAG_OR:	*te++ = '|';	break;
-	case POPT_ARGFLAG_AND:	*te++ = '&';	break;
-	case POPT_ARGFLAG_XOR:	*te++ = '^';	break;
+    case POPT_ARGFLAG_OR:	retval = arg0 | arg1;	break;
+    case POPT_ARGFLAG_AND:	retval = arg0 & arg1;	break;
+    case POPT_ARGFLAG_XOR:	retval = arg0 ^ arg1;	break;
+    case 0:
+	if (!LF_ISSET(CALCULATOR))
+	    retval = arg1;
+	else if (LF_ISSET(NOT))		/* XXX hotwire +/- operations. */
+	    retval = arg0 - arg1;
+	else
+	    retval = arg0 + arg1;
+	break;
     default:
-	if (LF_ISSET(CALCULATOR))	/* XXX hotwire +/- operations. */
-		*te++ = LF_ISSET(NOT) ? '-' : '+';
-	else if (!LF_ISSET(LOGICALOPS))
-		*te++ = '=';
-	else {
-	    rc = POPT_ERROR_BADOPERATION;
-	    goto exit;
-	}
+	rc = POPT_ERROR_BADOPERATION;
 	break;
     }
-	*te = '\0';
-    }
-
-s = (expr ? expr : t);
-xx = poptParseArgvString(s, &ac, &av);	/* XXX split on CSV character set. */
-assert(!xx && av);
-
-    if (av)
-    for (i = 0; av[i] != NULL; i++) {
-	const char * arg = av[i];
-	size_t len = strlen(arg);
-	int c = (int) *arg;
-
-	if (len == 0)
-	    continue;
-	if (len > 1) {
-	    char * end = NULL;
-	    if (ix >= ixmax) {
-		rc = POPT_ERROR_STACKOVERFLOW;
-		goto exit;
-	    }
-	    stk[ix++] = strtoll(arg, &end, 0);
-	    if (end && *end != '\0') {
-		rc = POPT_ERROR_BADNUMBER;
-		goto exit;
-	    }
-	} else {
-	    if (ix-- < 2) {
-		rc = POPT_ERROR_STACKUNDERFLOW;
-		goto exit;
-	    }
-	    switch (c) {
-	    case 'd':		/* duplicate */
-		ix++;
-		stk[ix] = stk[ix-1];
-		ix++;
-		break;		/* XXX FIXME: initial arg0 cannot be dupe'd. */
-	    case 'P':		/* pop */
-		break;		/* XXX FIXME: initial arg0 cannot be pop'd. */
-	    case 'r':		/* reverse */
-		ix++;
-		stk[ix] = stk[ix-2];
-		stk[ix-2] = stk[ix-1];
-		stk[ix-1] = stk[ix];
-		break;
-	    case '=':	stk[ix-1]  = stk[ix];	break;
-	    case '|':	stk[ix-1] |= stk[ix];	break;
-	    case '&':	stk[ix-1] &= stk[ix];	break;
-	    case '^':	stk[ix-1] ^= stk[ix];	break;
-	    case '+':	stk[ix-1] += stk[ix];	break;
-	    case '-':	stk[ix-1] -= stk[ix];	break;
-	    case '*':	stk[ix-1] *= stk[ix];	break;
-	    case '/':
-	    case '%':
-		if (stk[ix] == 0) {
-		    rc = POPT_ERROR_BADOPERATION; /* XXX POPT_ERROR_DIVZERO */
-		    goto exit;
-		}
-		if (c == (int)'%')
-		    stk[ix-1] %= stk[ix];
-		else
-		    stk[ix-1] /= stk[ix];
-		break;
-	    default:
-		rc = POPT_ERROR_BADOPERATION;
-		goto exit;
-		/*@notreached@*/ break;
-	    }
-	}
-    }
-
-    if (ix-- < 1) {
-	rc = POPT_ERROR_STACKUNDERFLOW;
-	goto exit;
-    }
-    retval = stk[ix];
 
 exit:
-    if (av) {
-#if !defined(SUPPORT_CONTIGUOUS_ARGV)
-	for (i = 0; av[i]; i++)
-	    av[i] = _free(av[i]);
-#endif
-	av = _free(av);
-    }
     *rcp = rc;
     return retval;
 }
@@ -1174,7 +3403,8 @@ int poptSaveLongLong(long long * arg, unsigned int argInfo, long long aLongLong)
     )
 	return POPT_ERROR_NULLARG;
 
-    retval = poptCalculator(*arg, argInfo, (long long)aLongLong, NULL, &rc);
+    retval = poptCalculator(NULL, NULL, *arg, argInfo, (long long)aLongLong,
+		NULL, &rc);
     if (!rc)
 	*arg = (long long) retval;
 
@@ -1190,7 +3420,8 @@ int poptSaveLong(long * arg, unsigned int argInfo, long aLong)
     if (arg == NULL || (((unsigned long)arg) & (sizeof(*arg)-1)))
 	return POPT_ERROR_NULLARG;
 
-    retval = poptCalculator(*arg, argInfo, (long long)aLong, NULL, &rc);
+    retval = poptCalculator(NULL, NULL, *arg, argInfo, (long long)aLong,
+		NULL, &rc);
     if (!rc)
 	*arg = (long) retval;
 
@@ -1206,7 +3437,8 @@ int poptSaveInt(/*@null@*/ int * arg, unsigned int argInfo, long aLong)
     if (arg == NULL || (((unsigned long)arg) & (sizeof(*arg)-1)))
 	return POPT_ERROR_NULLARG;
 
-    retval = poptCalculator(*arg, argInfo, (long long)aLong, NULL, &rc);
+    retval = poptCalculator(NULL, NULL, *arg, argInfo, (long long)aLong,
+		NULL, &rc);
     if (!rc)
 	*arg = (int) retval;
 
@@ -1222,7 +3454,8 @@ int poptSaveShort(/*@null@*/ short * arg, unsigned int argInfo, long aLong)
     if (arg == NULL || (((unsigned long)arg) & (sizeof(*arg)-1)))
 	return POPT_ERROR_NULLARG;
 
-    retval = poptCalculator(*arg, argInfo, (long long)aLong, NULL, &rc);
+    retval = poptCalculator(NULL, NULL, *arg, argInfo, (long long)aLong,
+		NULL, &rc);
     if (!rc)
 	*arg = (short) retval;
 
@@ -1258,8 +3491,63 @@ static unsigned int poptArgInfo(poptContext con, const struct poptOption * opt)
     return argInfo;
 }
 
+/**
+ * Return the value of a (hex) digit, locale independently.
+ * @param c		character
+ * @return		digit value, 36 if not a digit
+ */
+static unsigned poptDigitValue(int c)
+	/*@*/
+{
+    if (c >= '0' && c <= '9')
+	return (unsigned)(c - '0');
+    if (c >= 'a' && c <= 'f')
+	return (unsigned)(c - 'a') + 10U;
+    if (c >= 'A' && c <= 'F')
+	return (unsigned)(c - 'A') + 10U;
+    return 36U;
+}
+
+/**
+ * Scale by a K/M/G/T (1000^n) or Ki/Mi/Gi/Ti (1024^n) suffix.
+ * @param s		suffix string
+ * @retval *ullp	magnitude to scale
+ * @return		0 on success, otherwise POPT_* error.
+ */
+static int poptParseSuffix(const char * s, unsigned long long * ullp)
+	/*@modifies *ullp @*/
+{
+    unsigned long long base = 1000ULL;
+    int n;
+
+    switch (*s++) {
+    case '\0':	return 0;
+    case 'k':
+    case 'K':	n = 1;	/*@switchbreak@*/ break;
+    case 'M':	n = 2;	/*@switchbreak@*/ break;
+    case 'G':	n = 3;	/*@switchbreak@*/ break;
+    case 'T':	n = 4;	/*@switchbreak@*/ break;
+    default:	return POPT_ERROR_BADNUMBER;
+    }
+    if (*s == 'i') {
+	base = 1024ULL;
+	s++;
+    }
+    if (*s != '\0')
+	return POPT_ERROR_BADNUMBER;
+    while (n-- > 0) {
+	if (*ullp > ~0ULL / base)
+	    return POPT_ERROR_OVERFLOW;
+	*ullp *= base;
+    }
+    return 0;
+}
+
 /**
  * Parse an integer expression.
+ *
+ * Accepts what strtoll(3) accepts with base 0, followed by an optional
+ * scaling suffix, independent of locale and without touching errno.
  * @retval *llp		integer expression value
  * @param argInfo	integer expression type
  * @param val		integer expression string
@@ -1270,19 +3558,212 @@ static int poptParseInteger(long long * llp,
 		/*@null@*/ const char * val)
 	/*@modifies *llp @*/
 {
-    if (val) {
-	char *end = NULL;
-	*llp = strtoll(val, &end, 0);
+    const char * s = val;
+    unsigned long long ull = 0;
+    unsigned long long lim;
+    unsigned base = 10;
+    int overflow = 0;
+    int ndigits = 0;
+    int neg = 0;
+    int rc;
 
-	/* XXX parse scaling suffixes here. */
+    *llp = 0;
+    if (val == NULL || *val == '\0')
+	return 0;
 
-	if (!(end && *end == '\0'))
-	    return POPT_ERROR_BADNUMBER;
-    } else
-	*llp = 0;
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r'))
+	s++;
+    if (*s == '-' || *s == '+')
+	neg = (*s++ == '-');
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')
+     && poptDigitValue((int)s[2]) < 16U) {
+	base = 16;
+	s += 2;
+    } else if (s[0] == '0')
+	base = 8;
+
+    for (;; s++) {
+	unsigned d = poptDigitValue((int)*s);
+	if (d >= base)
+	    break;
+	if (ull > (~0ULL - d) / base)
+	    overflow = 1;
+	else
+	    ull = ull * base + d;
+	ndigits++;
+    }
+    if (ndigits == 0)
+	return POPT_ERROR_BADNUMBER;
+
+    if ((rc = poptParseSuffix(s, &ull)) != 0)
+	return rc;
+
+    lim = (unsigned long long) LLONG_MAX + (neg ? 1ULL : 0ULL);
+    if (overflow || ull > lim)
+	return POPT_ERROR_OVERFLOW;
+    *llp = (neg && ull ? -(long long)(ull - 1ULL) - 1LL : (long long)ull);
     return 0;
 }
 
+/*@unchecked@*/ /*@observer@*/
+static const double poptPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Parse a floating point number with strtod(3), in the "C" locale syntax.
+ * @retval *dp		floating point value
+ * @param val		floating point string
+ * @return		0 on success, otherwise POPT_* error.
+ */
+static int poptStrtod(double * dp, const char * val)
+	/*@globals errno @*/
+	/*@modifies *dp, errno @*/
+{
+    const char * dpt = ".";
+    char * b = NULL;
+    char * end = NULL;
+    const char * s;
+    int saveerrno = errno;
+    int rc = 0;
+
+    /* Only ASCII letters, digits and "+-.()_" (hex floats, inf/nan, nan(...))
+     * are in the C float grammar: the locale's decimal point is never seen. */
+    for (s = val; *s != '\0' && _isspaceptr(s); s++)
+	{};
+    for (; *s != '\0'; s++) {
+	int c = (unsigned char) *s;
+	if (!((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+	 || strchr("+-.()_", c) != NULL))
+	    return POPT_ERROR_BADNUMBER;
+    }
+
+#if defined(HAVE_LOCALE_H)
+    {	struct lconv * lc = localeconv();
+	if (lc != NULL && lc->decimal_point != NULL && *lc->decimal_point)
+	    dpt = lc->decimal_point;
+    }
+#endif
+    /* Swap the '.' for the locale's decimal point. */
+    if (strcmp(dpt, ".") && strchr(val, '.') != NULL) {
+	char * t = b = (char *) xmalloc(strlen(val) * strlen(dpt) + 1);
+	if (b == NULL)
+	    return POPT_ERROR_MALLOC;
+	for (s = val; *s != '\0'; s++) {
+	    if (*s == '.')
+		t = stpcpy(t, dpt);
+	    else
+		*t++ = *s;
+	}
+	*t = '\0';
+	val = b;
+    }
+
+    errno = 0;
+    *dp = strtod(val, &end);
+    if (errno == ERANGE)
+	rc = POPT_ERROR_OVERFLOW;
+    else if (end == val || *end != '\0')
+	rc = POPT_ERROR_BADNUMBER;
+    errno = saveerrno;
+    b = _free(b);
+    return rc;
+}
+
+/**
+ * Parse a floating point number.
+ *
+ * Decimals with at most 19 significant digits and a small exponent are
+ * converted exactly (and so correctly rounded) from an integer mantissa
+ * and a power of ten that are both exact doubles; everything else
+ * (hex floats, inf/nan, long mantissas) goes through strtod(3).
+ * @retval *dp		floating point value
+ * @param val		floating point string
+ * @return		0 on success, otherwise POPT_* error.
+ */
+static int poptParseDouble(double * dp, /*@null@*/ const char * val)
+	/*@globals errno @*/
+	/*@modifies *dp, errno @*/
+{
+    const char * s = val;
+    unsigned long long m = 0;
+    int nseen = 0;
+    int ndigits = 0;
+    int e10 = 0;
+    int neg = 0;
+
+    *dp = 0.0;
+    if (val == NULL || *val == '\0')
+	return 0;
+
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r'))
+	s++;
+    if (*s == '-' || *s == '+')
+	neg = (*s++ == '-');
+    for (; *s >= '0' && *s <= '9'; s++, nseen++) {
+	if (m == 0 && *s == '0')	/* leading zero */
+	    continue;
+	if (++ndigits > 19)
+	    goto slow;
+	m = 10 * m + (unsigned)(*s - '0');
+    }
+    if (*s == '.') {
+	s++;
+	for (; *s >= '0' && *s <= '9'; s++, nseen++) {
+	    if (m == 0 && *s == '0') {
+		e10--;
+		continue;
+	    }
+	    if (++ndigits > 19)
+		goto slow;
+	    m = 10 * m + (unsigned)(*s - '0');
+	    e10--;
+	}
+    }
+    if (nseen == 0)
+	goto slow;
+    if (*s == 'e' || *s == 'E') {
+	int eneg = 0;
+	int x = 0;
+	s++;
+	if (*s == '-' || *s == '+')
+	    eneg = (*s++ == '-');
+	if (!(*s >= '0' && *s <= '9'))
+	    goto slow;
+	for (; *s >= '0' && *s <= '9'; s++) {
+	    if (x > 1000)
+		goto slow;
+	    x = 10 * x + (*s - '0');
+	}
+	e10 += (eneg ? -x : x);
+    }
+    if (*s != '\0')
+	goto slow;
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    if (m == 0) {
+	*dp = (neg ? -0.0 : 0.0);
+	return 0;
+    }
+    /* Move excess exponent into the mantissa while it stays exact. */
+    while (e10 > 22 && m < (1ULL << 53) / 10) {
+	m *= 10;
+	e10--;
+    }
+    if (m <= (1ULL << 53) && e10 >= -22 && e10 <= 22) {
+	double d = (double) m;
+	d = (e10 < 0 ? d / poptPow10[-e10] : d * poptPow10[e10]);
+	*dp = (neg ? -d : d);
+	return 0;
+    }
+#endif
+
+slow:
+    return poptStrtod(dp, val);
+}
+
 /**
  * Save the option argument through the (*opt->arg) pointer.
  * @param con		context
@@ -1299,14 +3780,55 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 
     switch (poptArgType(opt)) {
     case POPT_ARG_BITSET:
+	/* A context in a caller's block can't malloc the bit set. */
+	if (con->block != NULL) {
+	    rc = POPT_ERROR_MALLOC;
+	    /*@switchbreak@*/ break;
+	}
 	/* XXX memory leak, application is responsible for free. */
 	rc = poptSaveBits(arg.ptr, opt->argInfo, con->os->nextArg);
 	/*@switchbreak@*/ break;
     case POPT_ARG_ARGV:
+    case POPT_ARG_COUNTED_ARGV:
+	/* A context in a caller's block can't malloc the array. */
+	if (con->block != NULL) {
+	    rc = POPT_ERROR_MALLOC;
+	    /*@switchbreak@*/ break;
+	}
+	/* A counted argv is released with poptFreeArgv(). */
+	if (poptArgType(opt) == POPT_ARG_COUNTED_ARGV) {
+	    rc = poptSaveCountedArgv(arg.ptr, opt->argInfo, con->os->nextArg);
+	    /*@switchbreak@*/ break;
+	}
 	/* XXX memory leak, application is responsible for free. */
-	rc = poptSaveString(arg.ptr, opt->argInfo, con->os->nextArg);
+	rc = poptSaveArgvString(con, arg.ptr, con->os->nextArg);
 	/*@switchbreak@*/ break;
     case POPT_ARG_STRING:
+	/* A context in a caller's block stores the (borrowed) argument. */
+	if (con->block != NULL || (F_ISSET(opt, BORROW)
+	 && (con->arena != NULL || !con->os->nextArgOwned)))
+	{
+	    arg.argv[0] = con->os->nextArg;
+	    /*@switchbreak@*/ break;
+	}
+	/* Keep a substituted copy for a borrowed argument until the end. */
+	if (F_ISSET(opt, BORROW)) {
+	    if (con->nkept == con->maxkept) {
+		size_t maxkept = (con->maxkept > 0 ? 2 * con->maxkept : 8);
+		poptArgv kept = (poptArgv) xrealloc(con->kept,
+			maxkept * sizeof(*con->kept));
+		if (kept == NULL) {
+		    rc = POPT_ERROR_MALLOC;
+		    /*@switchbreak@*/ break;
+		}
+		con->kept = kept;
+		con->maxkept = maxkept;
+	    }
+	    con->kept[con->nkept++] = con->os->nextArg;
+	    con->os->nextArgOwned = 0;
+	    arg.argv[0] = con->os->nextArg;
+	    /*@switchbreak@*/ break;
+	}
 	/* XXX memory leak, application is responsible for free. */
 	arg.argv[0] = (con->os->nextArg) ? xstrdup(con->os->nextArg) : NULL;
 	/*@switchbreak@*/ break;
@@ -1319,7 +3841,7 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
     case POPT_ARG_VAL:
     {	unsigned argInfo = poptArgInfo(con, opt);
 	long long aNUM = 0;
-	const char * expr = LF_ISSET(CALCULATOR) ? opt->argDescrip : NULL;
+	poptCalc calc = (LF_ISSET(CALCULATOR) ? con->calc : NULL);
 
 	if (poptArgType(opt) == POPT_ARG_NONE)
 	    aNUM = 1LL;
@@ -1330,17 +3852,9 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 
 	switch (poptArgType(opt)) {
 	case POPT_ARG_LONGLONG:
-/* XXX let's not demand C99 compiler flags for <limits.h> quite yet. */
-#if !defined(LLONG_MAX)
-#   define LLONG_MAX    9223372036854775807LL
-#   define LLONG_MIN    (-LLONG_MAX - 1LL)
-#endif
-	    if (aNUM == LLONG_MIN || aNUM == LLONG_MAX) {
-		rc = POPT_ERROR_OVERFLOW;
-		goto exit;
-	    }
 	    /* XXX pointer alignment check? */
-	    aNUM = poptCalculator(arg.longlongp[0], argInfo, aNUM, expr, &rc);
+	    aNUM = poptCalculator(con, arg.ptr, arg.longlongp[0], argInfo, aNUM,
+			calc, &rc);
 	    if (!rc)
 		arg.longlongp[0] = (long long) aNUM;
 	    /*@innerbreak@*/ break;
@@ -1350,7 +3864,8 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 		goto exit;
 	    }
 	    /* XXX pointer alignment check? */
-	    aNUM = poptCalculator(arg.longp[0], argInfo, aNUM, expr, &rc);
+	    aNUM = poptCalculator(con, arg.ptr, arg.longp[0], argInfo, aNUM,
+			calc, &rc);
 	    if (!rc)
 		arg.longp[0] = (long) aNUM;
 	    /*@innerbreak@*/ break;
@@ -1363,7 +3878,8 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 	case POPT_ARG_NONE:
 	case POPT_ARG_VAL:
 	    /* XXX pointer alignment check? */
-	    aNUM = poptCalculator(arg.intp[0], argInfo, aNUM, expr, &rc);
+	    aNUM = poptCalculator(con, arg.ptr, arg.intp[0], argInfo, aNUM,
+			calc, &rc);
 	    if (!rc)
 		arg.intp[0] = (int) aNUM;
 	    /*@innerbreak@*/ break;
@@ -1373,7 +3889,8 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 		goto exit;
 	    }
 	    /* XXX pointer alignment check? */
-	    aNUM = poptCalculator(arg.shortp[0], argInfo, aNUM, expr, &rc);
+	    aNUM = poptCalculator(con, arg.ptr, arg.shortp[0], argInfo, aNUM,
+			calc, &rc);
 	    if (!rc)
 		arg.shortp[0] = (short) aNUM;
 	    /*@innerbreak@*/ break;
@@ -1382,25 +3899,10 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 
     case POPT_ARG_FLOAT:
     case POPT_ARG_DOUBLE:
-    {	char *end = NULL;
-	double aDouble = 0.0;
-
-	if (con->os->nextArg) {
-/*@-mods@*/
-	    int saveerrno = errno;
-	    errno = 0;
-	    aDouble = strtod(con->os->nextArg, &end);
-	    if (errno == ERANGE) {
-		rc = POPT_ERROR_OVERFLOW;
-		goto exit;
-	    }
-	    errno = saveerrno;
-/*@=mods@*/
-	    if (*end != '\0') {
-		rc = POPT_ERROR_BADNUMBER;
-		goto exit;
-	    }
-	}
+    {	double aDouble = 0.0;
+
+	if ((rc = poptParseDouble(&aDouble, con->os->nextArg)) != 0)
+	    goto exit;
 
 	switch (poptArgType(opt)) {
 	case POPT_ARG_DOUBLE:
@@ -1455,21 +3957,28 @@ int poptGetNextOpt(poptContext con)
 
 	while (!con->os->nextCharArg && con->os->next == con->os->argc
 		&& con->os > con->optionStack) {
-	    cleanOSE(con->os--);
+	    cleanOSE(con, con->os--);
 	}
 
 	if (!con->os->nextCharArg && con->os->next == con->os->argc) {
-	    invokeCallbacksPOST(con, con->options);
+	    invokeCallbacksPOST(con);
 
 	    if (con->maincall) {
+		poptArgv av = NULL;
+		int ac = 0;
+		if (con->ac > 0 && (av = poptAvArgv(con, &ac)) == NULL) {
+		    rc = POPT_ERROR_MALLOC;
+		    goto exit;
+		}
 		/*@-noeffectuncon @*/
-		(void) (*con->maincall) (con->ac, con->av);
+		(void) (*con->maincall) (ac, av);
 		/*@=noeffectuncon @*/
+		av = _free(av);
 		rc = -1;
 		goto exit;
 	    }
 
-	    rc = (con->doExec) ? execCommand(con) : -1;
+	    rc = (con->doExec >= 0) ? execCommand(con) : -1;
 	    goto exit;
 	}
 
@@ -1502,7 +4011,10 @@ assert(origOptString);	/* XXX can't happen */
 		if (con->flags & POPT_CONTEXT_POSIXMEHARDER)
 		    con->restLeftover = 1;
 		if (con->flags & POPT_CONTEXT_ARG_OPTS) {
-		    con->os->nextArg = xstrdup(origOptString);
+		    con->os->nextArgOwned = (con->arena == NULL && con->os->stuffed);
+		    con->os->nextArg = (con->os->nextArgOwned
+				? conStrdup(con, origOptString)
+				: (char *) origOptString);
 		    rc = 0;
 		    goto exit;
 		}
@@ -1542,7 +4054,9 @@ assert(con->leftovers);		/* XXX can't happen */
 		    longArg = oe + 1;
 
 		/* XXX aliases with arg substitution need "--alias=arg" */
-		if (handleAlias(con, optString, optStringLen, '\0', longArg)) {
+		if ((rc = handleAlias(con, optString, optStringLen, '\0', longArg)) != 0) {
+		    if (rc < 0)
+			goto exit;
 		    longArg = NULL;
 		    continue;
 		}
@@ -1550,8 +4064,20 @@ assert(con->leftovers);		/* XXX can't happen */
 		if (handleExec(con, optString, '\0'))
 		    continue;
 
-		opt = findOption(con->options, optString, optStringLen,
+		opt = findOption(con, optString, optStringLen,
 				'\0', &cb, &cbData, argInfo);
+
+		/* Try a unique prefix of a --long option name. */
+		if (!opt && !LF_ISSET(ONEDASH)
+		 && (con->flags & POPT_CONTEXT_ALLOW_ABBREV))
+		{
+		    int i = poptTableAbbrev(con->table, optString, optStringLen);
+		    if (i == -2) {
+			rc = POPT_ERROR_AMBIGUOUS;
+			goto exit;
+		    }
+		    opt = findEntry(con, i, &cb, &cbData);
+		}
 		if (!opt && !LF_ISSET(ONEDASH)) {
 		    rc = POPT_ERROR_BADOPT;
 		    goto exit;
@@ -1576,18 +4102,24 @@ assert(con->leftovers);		/* XXX can't happen */
 
 	    con->os->nextCharArg = NULL;
 
-	    if (handleAlias(con, NULL, 0, *nextCharArg, nextCharArg + 1))
-		continue;
+	    /* Skip alias/exec lookup for characters that have neither. */
+	    if (ITEMSHORT_ISSET(con, *nextCharArg)) {
+		if ((rc = handleAlias(con, NULL, 0, *nextCharArg, nextCharArg + 1)) != 0) {
+		    if (rc < 0)
+			goto exit;
+		    continue;
+		}
 
-	    if (handleExec(con, NULL, *nextCharArg)) {
-		/* Restore rest of short options for further processing */
-		nextCharArg++;
-		if (*nextCharArg != '\0')
-		    con->os->nextCharArg = nextCharArg;
-		continue;
+		if (handleExec(con, NULL, *nextCharArg)) {
+		    /* Restore rest of short options for further processing */
+		    nextCharArg++;
+		    if (*nextCharArg != '\0')
+			con->os->nextCharArg = nextCharArg;
+		    continue;
+		}
 	    }
 
-	    opt = findOption(con->options, NULL, 0,
+	    opt = findOption(con, NULL, 0,
 				*nextCharArg, &cb, &cbData, 0);
 	    if (!opt) {
 		rc = POPT_ERROR_BADOPT;
@@ -1615,20 +4147,24 @@ assert(opt != NULL);	/* XXX can't happen */
 		rc = POPT_ERROR_UNWANTEDARG;
 	    break;
 	default:
-	    con->os->nextArg = _free(con->os->nextArg);
+	    con->os->nextArg = conFreeArg(con, con->os);
 	    if (longArg) {
 		longArg = expandNextArg(con, longArg);
 		con->os->nextArg = (char *) longArg;
+		if (longArg == NULL)
+		    rc = POPT_ERROR_MALLOC;
 	    } else if (con->os->nextCharArg) {
 		int skip = (con->os->nextCharArg[0] == '=');
 		longArg = expandNextArg(con, con->os->nextCharArg + skip);
 		con->os->nextArg = (char *) longArg;
 		con->os->nextCharArg = NULL;
+		if (longArg == NULL)
+		    rc = POPT_ERROR_MALLOC;
 	    } else {
 		while (con->os->next == con->os->argc &&
 			con->os > con->optionStack)
 		{
-		    cleanOSE(con->os--);
+		    cleanOSE(con, con->os--);
 		}
 		if (con->os->next == con->os->argc) {
 		    if (!F_ISSET(opt, OPTIONAL)) {
@@ -1652,6 +4188,8 @@ assert(con->os->argv);	/* XXX can't happen */
 			    longArg = con->os->argv[con->os->next++];
 			    longArg = expandNextArg(con, longArg);
 			    con->os->nextArg = (char *) longArg;
+			    if (longArg == NULL)
+				rc = POPT_ERROR_MALLOC;
 			}
 		    }
 		}
@@ -1667,41 +4205,25 @@ assert(con->os->argv);	/* XXX can't happen */
 	else if (opt->val && (poptArgType(opt) != POPT_ARG_VAL))
 	    done = 1;
 
-	if ((con->ac + 2) >= (con->nav)) {
-	    con->nav += 10;
-	    con->av = (poptArgv) xrealloc(con->av,
-			    sizeof(*con->av) * con->nav);
-	}
-
-assert(con->av);
-	if (con->av) {
-	    size_t nb = (opt->longName ? strlen(opt->longName) : 0) + sizeof("--");
-	    char *s = (char*) xmalloc(nb);
-assert(s);	/* XXX can't happen */
-	    if (s != NULL) {
-		con->av[con->ac++] = s;
-		*s++ = '-';
-		if (opt->longName) {
-		    if (!F_ISSET(opt, ONEDASH))
-			*s++ = '-';
-		    s = stpcpy(s, opt->longName);
-		} else {
-		    *s++ = opt->shortName;
-		    *s = '\0';
-		}
-	    } else
-		con->av[con->ac++] = NULL;
-	}
+	/* Only an exec or main call needs the options seen so far. */
+	if (con->block != NULL
+	 || (con->numExecs == 0 && con->table->nmaincalls == 0))
+	    continue;
 
+	/* The argv strings are only built when an exec fires. */
 	switch (poptArgType(opt)) {
 	case POPT_ARG_NONE:
 	case POPT_ARG_VAL:
+	    rc = poptAvAdd(con, opt, -1, (opt->longName ? '\0' : opt->shortName),
+			NULL);
 	    break;
 	default:
-	    if (con->os->nextArg)
-	        con->av[con->ac++] = xstrdup(con->os->nextArg);
+	    rc = poptAvAdd(con, opt, -1, (opt->longName ? '\0' : opt->shortName),
+			con->os->nextArg);
 	    break;
 	}
+	if (rc)
+	    goto exit;
 
     }
 assert(opt);	/* XXX can't happen */
@@ -1716,11 +4238,35 @@ char * poptGetOptArg(poptContext con)
     char * ret = NULL;
     if (con) {
 	ret = con->os->nextArg;
+	/* Without an arena, the caller frees (a copy of) the argument. */
+	if (ret != NULL && con->arena == NULL && !con->os->nextArgOwned)
+	    ret = xstrdup(ret);
 	con->os->nextArg = NULL;
+	con->os->nextArgOwned = 0;
     }
     return ret;
 }
 
+const char * poptGetOptArgView(poptContext con, size_t * lenp)
+{
+    const char * ret = NULL;
+    if (con)
+	ret = con->os->nextArg;
+    if (lenp)
+	*lenp = (ret ? strlen(ret) : 0);
+    return ret;
+}
+
+int poptGetCalcStack(poptContext con, const long long ** stkp)
+{
+    int n = 0;
+    if (con)
+	n = (int) (con->stk - con->calcStack);
+    if (stkp)
+	*stkp = (con && n > 0 ? con->calcStack : NULL);
+    return n;
+}
+
 const char * poptGetArg(poptContext con)
 {
     const char * ret = NULL;
@@ -1779,20 +4325,57 @@ poptContext poptFreeContext(poptContext con)
 {
     if (con == NULL) return con;
     poptResetContext(con);
-    con->os->argb = _free(con->os->argb);
+    con->os->argb = conFree(con, con->os->argb);
+    con->arg_strip = conFree(con, con->arg_strip);
 
+    if (con->aliasTemplates != NULL) {
+	int i;
+	for (i = 0; i < con->numAliases; i++)
+	    con->aliasTemplates[i] = conKeepFree(con, con->aliasTemplates[i]);
+	con->aliasTemplates = conKeepFree(con, con->aliasTemplates);
+    }
+    if (con->block != NULL) {
+	/* Only the alias argv's are the caller's (malloc'd) memory. */
+	int i;
+	for (i = 0; i < con->numAliases; i++) {
+#if !defined(SUPPORT_CONTIGUOUS_ARGV)
+	    int j;
+	    for (j = 0; con->aliases[i].argv[j]; j++)
+		con->aliases[i].argv[j] = _free(con->aliases[i].argv[j]);
+#endif
+	    con->aliases[i].argv = _free(con->aliases[i].argv);
+	}
+	con->aliases = NULL;
+    } else
     con->aliases = poptFreeItems(con->aliases, con->numAliases);
-    con->numAliases = 0;
+    con->numAliases = con->maxAliases = 0;
+    con->aliasIndex = poptItemIndexFree(con, con->aliasIndex);
 
     con->execs = poptFreeItems(con->execs, con->numExecs);
-    con->numExecs = 0;
+    con->numExecs = con->maxExecs = 0;
+    con->execIndex = poptItemIndexFree(con, con->execIndex);
+
+    con->otherHelp = conKeepFree(con, con->otherHelp);
+    con->saves = conKeepFree(con, con->saves);
+    con->nsaves = con->maxsaves = 0;
+    con->execPath = _free(con->execPath);
+    if (con->kept != NULL) {
+	size_t i;
+	for (i = 0; i < con->nkept; i++)
+	    con->kept[i] = _free(con->kept[i]);
+	con->kept = _free(con->kept);
+	con->nkept = con->maxkept = 0;
+    }
+
+    /* The rest of a context in a caller's block belongs to the caller. */
+    if (con->block != NULL)
+	return NULL;
 
     con->leftovers = _free(con->leftovers);
     con->av = _free(con->av);
+    con->arena = poptArenaFree(con->arena);
+    con->privateTable = poptFreeCompiledTable(con->privateTable);
     con->appName = _free(con->appName);
-    con->otherHelp = _free(con->otherHelp);
-    con->execPath = _free(con->execPath);
-    con->arg_strip = PBM_FREE(con->arg_strip);
 
     con = _free(con);
     return con;
@@ -1816,6 +4399,50 @@ int poptAddAlias(poptContext con, struct poptAlias alias,
     return poptAddItem(con, item, 0);
 }
 
+/**
+ * Compile an alias argv into its "!#:+" substitution slots.
+ * @param con		context
+ * @param argc		no. of arguments
+ * @param argv		argument array
+ * @return		compiled alias argv (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+static poptArgTemplate poptArgTemplateNew(poptContext con, int argc,
+		/*@null@*/ const char ** argv)
+	/*@modifies con @*/
+{
+    poptArgTemplate tp;
+    const char * se;
+    int nslots = 0;
+    int i;
+
+    if (argv == NULL || argc < 0)
+	return NULL;
+    for (i = 0; i < argc; i++) {
+	for (se = argv[i]; (se = strstr(se, "!#:+")) != NULL; se += sizeof("!#:+") - 1)
+	    nslots++;
+    }
+
+    /* Everything is in one block: lengths and offsets, then slot indices. */
+    tp = (poptArgTemplate) conKeepRealloc(con, NULL, 0, sizeof(*tp)
+		+ (argc + nslots) * sizeof(*tp->lens)
+		+ (argc + 1) * sizeof(*tp->first));
+    if (tp == NULL)
+	return NULL;
+    tp->lens = (size_t *) (tp + 1);
+    tp->slots = tp->lens + argc;
+    tp->first = (int *) (tp->slots + nslots);
+    nslots = 0;
+    for (i = 0; i < argc; i++) {
+	tp->lens[i] = strlen(argv[i]);
+	tp->first[i] = nslots;
+	for (se = argv[i]; (se = strstr(se, "!#:+")) != NULL; se += sizeof("!#:+") - 1)
+	    tp->slots[nslots++] = (size_t) (se - argv[i]);
+    }
+    tp->first[argc] = nslots;
+    return tp;
+}
+
 int poptAddItem(poptContext con, poptItem newItem, int flags)
 {
     poptItem * items, item;
@@ -1824,14 +4451,43 @@ int poptAddItem(poptContext con, poptItem newItem, int flags)
 
     switch (flags) {
     case 1:
+	/* A context in a caller's block has no av to exec with. */
+	if (con->block != NULL)
+	    return 1;
 	items = &con->execs;
 	nitems = &con->numExecs;
-      *items = (poptItem) xrealloc(*items, ((*nitems) + 1) * sizeof(**items));
+	/* Capacity doubles, so adding n items is O(n) overall. */
+	if (*nitems == con->maxExecs) {
+	    size_t n = (con->maxExecs > 0 ? 2 * con->maxExecs : 8);
+	    if ((item = (poptItem) xrealloc(*items, n * sizeof(**items))) == NULL)
+		return 1;
+	    *items = item;
+	    con->maxExecs = n;
+	}
 	break;
     case 0:
 	items = &con->aliases;
 	naliases = &con->numAliases;
-      *items = (poptItem) xrealloc(*items, ((*naliases) + 1) * sizeof(**items));
+	if (*naliases == con->maxAliases) {
+	    int n = (con->maxAliases > 0 ? 2 * con->maxAliases : 8);
+	    size_t o = (size_t) con->maxAliases;
+	    poptArgTemplate * tpl;
+	    if ((item = (poptItem) conKeepRealloc(con, *items,
+			o * sizeof(**items), n * sizeof(**items))) == NULL)
+		return POPT_ERROR_MALLOC;
+	    *items = item;
+	    tpl = (poptArgTemplate *) conKeepRealloc(con, con->aliasTemplates,
+			o * sizeof(*tpl), n * sizeof(*tpl));
+	    if (tpl == NULL)
+		return POPT_ERROR_MALLOC;
+	    con->aliasTemplates = tpl;
+	    con->maxAliases = n;
+	}
+	/* Expansion then copies known lengths, and never scans the argv. */
+	con->aliasTemplates[*naliases] =
+		poptArgTemplateNew(con, newItem->argc, newItem->argv);
+	if (con->block != NULL && con->aliasTemplates[*naliases] == NULL)
+	    return POPT_ERROR_MALLOC;
 	break;
     default:
 	return 1;
@@ -1844,22 +4500,32 @@ assert(*items);	/* XXX can't happen */
 
     item =(flags ? (*items) + (*nitems) : (*items) + (*naliases) );
 
-    item->option.longName =
-	(newItem->option.longName ? xstrdup(newItem->option.longName) : NULL);
+    item->option.longName = (newItem->option.longName
+	? conKeepStrdup(con, newItem->option.longName) : NULL);
     item->option.shortName = newItem->option.shortName;
     item->option.argInfo = newItem->option.argInfo;
     item->option.arg = newItem->option.arg;
     item->option.val = newItem->option.val;
-    item->option.descrip =
-	(newItem->option.descrip ? xstrdup(newItem->option.descrip) : NULL);
-    item->option.argDescrip =
-       (newItem->option.argDescrip ? xstrdup(newItem->option.argDescrip) : NULL);
+    item->option.descrip = (newItem->option.descrip
+	? conKeepStrdup(con, newItem->option.descrip) : NULL);
+    item->option.argDescrip = (newItem->option.argDescrip
+	? conKeepStrdup(con, newItem->option.argDescrip) : NULL);
+    if (con->block != NULL
+     && ((newItem->option.longName && item->option.longName == NULL)
+      || (newItem->option.descrip && item->option.descrip == NULL)
+      || (newItem->option.argDescrip && item->option.argDescrip == NULL)))
+	return POPT_ERROR_MALLOC;
     item->argc = newItem->argc;
     item->argv = newItem->argv;
 
+    if (item->option.shortName)
+	ITEMSHORT_SET(con, item->option.shortName);
+
     (flags ? (*nitems)++ : (*naliases)++ );
 
-    return 0;
+    if (flags)
+	return poptItemIndexAdd(con, &con->execIndex, *items, (int)*nitems, 0);
+    return poptItemIndexAdd(con, &con->aliasIndex, *items, *naliases, 1);
 }
 
 const char * poptBadOption(poptContext con, unsigned int flags)
@@ -1901,6 +4567,10 @@ const char * poptStrerror(const int error)
 	return POPT_("stack underflow");
       case POPT_ERROR_STACKOVERFLOW:
 	return POPT_("stack overflow");
+      case POPT_ERROR_AMBIGUOUS:
+	return POPT_("ambiguous option");
+      case POPT_ERROR_BADBITS:
+	return POPT_("bad bit set file");
       case POPT_ERROR_ERRNO:
 	return strerror(errno);
       default:
@@ -1922,9 +4592,10 @@ int poptStuffArgs(poptContext con, const char ** argv)
     con->os++;
     con->os->next = 0;
     con->os->nextArg = NULL;
+    con->os->nextArgOwned = 0;
     con->os->nextCharArg = NULL;
     con->os->currAlias = NULL;
-    rc = poptDupArgv(argc, argv, &con->os->argc, &con->os->argv);
+    rc = conDupArgv(con, argc, argv, &con->os->argc, &con->os->argv);
     con->os->argb = NULL;
     con->os->stuffed = 1;
 
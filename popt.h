@@ -37,6 +37,7 @@
 #define	POPT_ARG_ARGV		12U	/*!< dupe'd arg appended to realloc'd argv array. */
 #define	POPT_ARG_SHORT		13U	/*!< arg ==> short */
 #define	POPT_ARG_BITSET		16U+14U	/*!< arg ==> bit set */
+#define	POPT_ARG_COUNTED_ARGV	(16U+15U)	/*!< dupe'd arg appended to counted argv array. */
 
 #define POPT_ARG_MASK		0x000000FFU
 #define POPT_GROUP_MASK		0x0000FF00U
@@ -70,6 +71,7 @@
 #define	POPT_ARGFLAG_RANDOM	0x00400000U  /*!< random value in [1,arg] */
 #define	POPT_ARGFLAG_TOGGLE	0x00200000U  /*!< permit --[no]opt prefix toggle */
 #define	POPT_ARGFLAG_CALCULATOR	0x00100000U  /*!< argDescr has RPN string */
+#define	POPT_ARGFLAG_BORROW	0x00080000U  /*!< string arg is borrowed, not dupe'd */
 
 /*@}*/
 
@@ -103,6 +105,8 @@
 #define	POPT_ERROR_UNWANTEDARG	-23	/*!< option does not take an argument */
 #define	POPT_ERROR_STACKUNDERFLOW	-24	/*!< stack underflow */
 #define	POPT_ERROR_STACKOVERFLOW	-25	/*!< stack overflow */
+#define	POPT_ERROR_AMBIGUOUS	-26	/*!< abbreviated option is ambiguous */
+#define	POPT_ERROR_BADBITS	-27	/*!< bit set file is damaged or incompatible */
 /*@}*/
 
 /** \ingroup popt
@@ -120,6 +124,8 @@
 #define POPT_CONTEXT_KEEP_FIRST	(1U << 1)  /*!< pay attention to argv[0] */
 #define POPT_CONTEXT_POSIXMEHARDER (1U << 2) /*!< options can't follow args */
 #define POPT_CONTEXT_ARG_OPTS	(1U << 4) /*!< return args as options with value 0 */
+#define POPT_CONTEXT_ALLOW_ABBREV (1U << 5) /*!< accept unique --long option prefixes */
+#define POPT_CONTEXT_ARENA	(1U << 6) /*!< parse-time memory from a context arena */
 /*@}*/
 
 /** \ingroup popt
@@ -202,6 +208,23 @@ extern struct poptOption * poptHelpOptionsI18N;
 typedef /*@abstract@*/ struct poptContext_s * poptContext;
 /*@=exporttype@*/
 
+/** \ingroup popt
+ * An option table compiled for lookup, shareable by many contexts.
+ */
+/*@-exporttype@*/
+typedef /*@abstract@*/ struct poptCompiledTable_s * poptCompiledTable;
+/*@=exporttype@*/
+
+/** \ingroup popt
+ * A long option name matcher, usually generated by poptgen.
+ */
+struct poptMatcher {
+    /** Return the match number of a long option name (or -1). */
+    int (*match) (const char * s, size_t ns)
+	/*@*/;
+    int nmatch;		/*!< no. of match numbers */
+};
+
 /** \ingroup popt
  */
 #ifndef __cplusplus
@@ -268,6 +291,105 @@ poptContext poptGetContext(
 	/*@globals internalState @*/
 	/*@modifies internalState @*/;
 
+/** \ingroup popt
+ * Compile an option table for lookup.
+ * The compiled table is not modified after it is returned, so it may be
+ * shared by any number of contexts, including contexts in other threads.
+ * The option table, and the compiled table, must outlive those contexts.
+ * @param options	address of popt option table
+ * @return		compiled option table (NULL on error)
+ */
+/*@only@*/ /*@null@*/
+poptCompiledTable poptCompileTable(
+		/*@dependent@*/ /*@keep@*/ const struct poptOption * options)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/;
+
+/** \ingroup popt
+ * Compile an option table for lookup through a long option name matcher.
+ * Each long option name (including the "no" and "no-" names of toggles)
+ * must have its own match number, otherwise the table is not compiled.
+ * @param options	address of popt option table
+ * @param matcher	long option name matcher
+ * @return		compiled option table (NULL on error)
+ */
+/*@only@*/ /*@null@*/
+poptCompiledTable poptCompileTableMatcher(
+		/*@dependent@*/ /*@keep@*/ const struct poptOption * options,
+		/*@dependent@*/ /*@keep@*/ const struct poptMatcher * matcher)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/;
+
+/** \ingroup popt
+ * Destroy compiled option table.
+ * @param table		compiled option table
+ * @return		NULL always
+ */
+/*@null@*/
+poptCompiledTable poptFreeCompiledTable(
+		/*@only@*/ /*@null@*/ poptCompiledTable table)
+	/*@modifies table @*/;
+
+/** \ingroup popt
+ * Initialize popt context from a compiled option table.
+ * @param name		context name (usually argv[0] program name)
+ * @param argc		no. of arguments
+ * @param argv		argument array
+ * @param table		compiled option table
+ * @param flags		or'd POPT_CONTEXT_* bits
+ * @return		initialized popt context (NULL on error)
+ */
+/*@only@*/ /*@null@*/
+poptContext poptGetCompiledContext(
+		/*@dependent@*/ /*@keep@*/ const char * name,
+		int argc, /*@dependent@*/ /*@keep@*/ const char ** argv,
+		/*@dependent@*/ /*@keep@*/ const poptCompiledTable table,
+		unsigned int flags)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/;
+
+/** \ingroup popt
+ * Return the memory block size a context needs to parse argc arguments.
+ * The size covers parsing without "--alias=arg" or "!#:+" substitution,
+ * which need more (the length of the arguments involved).
+ * @param argc		no. of arguments
+ * @param options	address of popt option table
+ * @return		memory block size (0 on error)
+ */
+size_t poptContextBlockSize(int argc,
+		/*@null@*/ const struct poptOption * options)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/;
+
+/** \ingroup popt
+ * Initialize popt context in a caller supplied memory block, without malloc.
+ * The context, its compiled option table and all parse-time memory are
+ * allocated from the block, and poptFreeContext() leaves the block to the
+ * caller. POPT_ARG_STRING arguments are stored as pointers into argv (or
+ * the block), POPT_ARG_ARGV, POPT_ARG_COUNTED_ARGV and POPT_ARG_BITSET
+ * options are not supported, and neither are execs. Name and argv must outlive the context.
+ * Aliases and other option help are copied into the block too (so size it
+ * with room for them), and adding them fails with POPT_ERROR_MALLOC once
+ * it is full. Only reading a config file still uses malloc.
+ * @retval *conp	initialized popt context
+ * @param name		context name (usually argv[0] program name)
+ * @param argc		no. of arguments
+ * @param argv		argument array
+ * @param options	address of popt option table
+ * @param flags		or'd POPT_CONTEXT_* bits
+ * @param block		memory block
+ * @param blockSize	memory block size (see poptContextBlockSize())
+ * @return		0 on success, POPT_ERROR_MALLOC if the block is too small
+ */
+int poptGetContextBlock(/*@out@*/ poptContext * conp,
+		/*@dependent@*/ /*@keep@*/ const char * name,
+		int argc, /*@dependent@*/ /*@keep@*/ const char ** argv,
+		/*@dependent@*/ /*@keep@*/ const struct poptOption * options,
+		unsigned int flags,
+		/*@null@*/ void * block, size_t blockSize)
+	/*@globals internalState @*/
+	/*@modifies *conp, block, internalState @*/;
+
 /** \ingroup popt
  * Destroy context (alternative implementation).
  * @param con		context
@@ -301,6 +423,20 @@ poptContext poptInit(int argc, /*@dependent@*/ /*@keep@*/ const char ** argv,
 void poptResetContext(/*@null@*/poptContext con)
 	/*@modifies con @*/;
 
+/** \ingroup popt
+ * Reinitialize popt context to parse another argument array.
+ * Loaded aliases and execs are kept, and so is memory already allocated,
+ * which grows only to fit more arguments than before.
+ * @param con		context
+ * @param argc		no. of arguments
+ * @param argv		argument array
+ * @return		0 on success, POPT_ERROR_* on failure
+ */
+int poptRebindContext(/*@null@*/poptContext con,
+		int argc, /*@dependent@*/ /*@keep@*/ const char ** argv)
+	/*@globals internalState @*/
+	/*@modifies con, internalState @*/;
+
 /** \ingroup popt
  * Return value of next option found.
  * @param con		context
@@ -312,6 +448,9 @@ int poptGetNextOpt(/*@null@*/poptContext con)
 
 /** \ingroup popt
  * Return next option argument (if any).
+ * The caller frees the argument, except with POPT_CONTEXT_ARENA (or a
+ * context in a caller's block), where it is owned by the context (or argv)
+ * until poptResetContext() or poptFreeContext().
  * @param con		context
  * @return		option argument, NULL if no argument is available
  */
@@ -319,6 +458,34 @@ int poptGetNextOpt(/*@null@*/poptContext con)
 char * poptGetOptArg(/*@null@*/poptContext con)
 	/*@modifies con @*/;
 
+/** \ingroup popt
+ * Return a view of the next option argument (if any), without copying it.
+ * The argument points into argv (or an alias) unless a "!#:+" substitution
+ * made a new string, and is valid until the next poptGetNextOpt() call.
+ * @param con		context
+ * @retval *lenp	option argument length (if not NULL)
+ * @return		option argument, NULL if no argument is available
+ */
+/*@observer@*/ /*@null@*/ /*@unused@*/
+const char * poptGetOptArgView(/*@null@*/poptContext con,
+		/*@null@*/ /*@out@*/ size_t * lenp)
+	/*@modifies *lenp @*/;
+
+/** \ingroup popt
+ * Return the POPT_ARGFLAG_CALCULATOR stack.
+ * Successive calculator options that save to the same variable continue
+ * one computation, so values an expression leaves below its result are
+ * there for the next expression, until the oldest are dropped to make room.
+ * The top of the stack is the last result.
+ * @param con		context
+ * @retval *stkp	calculator stack, bottom first (if not NULL)
+ * @return		no. of values on the stack
+ */
+/*@unused@*/
+int poptGetCalcStack(/*@null@*/poptContext con,
+		/*@null@*/ /*@out@*/ const long long ** stkp)
+	/*@modifies *stkp @*/;
+
 /** \ingroup popt
  * Return next argument.
  * @param con		context
@@ -573,6 +740,8 @@ void poptPrintUsage(poptContext con, FILE * fp, /*@unused@*/ int flags)
 
 /** \ingroup popt
  * Provide text to replace default "[OPTION...]" in help/usage output.
+ * A context in a caller's block copies the text into the block, and
+ * keeps the default if it does not fit.
  * @param con		context
  * @param text		replacement text
  */
@@ -616,6 +785,38 @@ int poptSaveString(/*@null@*/ const char *** argvp, unsigned int argInfo,
 		/*@null@*/const char * val)
 	/*@modifies *argvp @*/;
 
+/**
+ * Add a string to a counted argv array (as used by POPT_ARG_COUNTED_ARGV).
+ * The array carries its count and capacity in a hidden header, so adding
+ * is amortized O(1). Release it with poptFreeArgv(), not free(3).
+ * @retval *argvp	counted argv array (lazily malloc'd if NULL)
+ * @param argInfo	(unused)
+ * @param val		string arg to add (using strdup)
+ * @return		0 on success, POPT_ERROR_NULLARG/POPT_ERROR_MALLOC
+ */
+/*@unused@*/
+int poptSaveCountedArgv(/*@null@*/ const char *** argvp, unsigned int argInfo,
+		/*@null@*/const char * val)
+	/*@modifies *argvp @*/;
+
+/**
+ * Return no. of strings in a counted argv array.
+ * @param argv		counted argv array (or NULL)
+ * @return		no. of strings
+ */
+/*@unused@*/
+int poptArgvCount(/*@null@*/ const char ** argv)
+	/*@*/;
+
+/**
+ * Destroy a counted argv array, and the strings in it.
+ * @param argv		counted argv array (or NULL)
+ * @return		NULL always
+ */
+/*@unused@*/ /*@null@*/
+const char ** poptFreeArgv(/*@only@*/ /*@null@*/ const char ** argv)
+	/*@modifies argv @*/;
+
 /**
  * Save a long long, performing logical operation with value.
  * @warning Alignment check may be too strict on certain platorms.
@@ -684,6 +885,14 @@ int poptSaveInt(/*@null@*/ int * arg, unsigned int argInfo, long aLong)
 /* The bit set typedef. */
 /*@-exporttype@*/
 typedef struct poptBits_s {
+    unsigned int N;		/*!< estimated population */
+    unsigned int M;		/*!< no. of bits (or counters) */
+    unsigned int K;		/*!< no. of bits set per string */
+    unsigned int flags;		/*!< layout (POPT_BITS_*) */
+    unsigned int magic;		/*!< (saved sets) file magic */
+    unsigned int version;	/*!< (saved sets) file format version */
+    unsigned int hash;		/*!< (saved sets) hash identity */
+    unsigned int _pad[9];	/*!< (bits on a 64 byte boundary) */
     unsigned int bits[1];
 } * poptBits;
 /*@=exporttype@*/
@@ -692,6 +901,11 @@ typedef struct poptBits_s {
 #define _POPT_BITS_M    ((3U * _POPT_BITS_N) / 2U)
 #define _POPT_BITS_K    16U      /* no. of linear hash combinations */
 
+#define POPT_BITS_BLOCKED	(1U << 0) /*!< all K bits of a string in one 64 byte block */
+#define POPT_BITS_COUNTING	(1U << 1) /*!< 4 bit counters, so poptBitsDel is safe */
+#define POPT_BITS_MAPPED	(1U << 31) /*!< (read-only) mapped by poptBitsMap() */
+
+/* Geometry of bit sets allocated on first use (e.g. by poptSaveBits). */
 /*@-exportlocal -exportvar -globuse @*/
 /*@unchecked@*/
 extern unsigned int _poptBitsN;
@@ -699,8 +913,21 @@ extern unsigned int _poptBitsN;
 extern  unsigned int _poptBitsM;
 /*@unchecked@*/
 extern  unsigned int _poptBitsK;
+/*@unchecked@*/
+extern  unsigned int _poptBitsFlags;
 /*@=exportlocal =exportvar =globuse @*/
 
+/**
+ * Create a bit set sized for a population and false positive rate.
+ * @param n		expected no. of strings
+ * @param fpr		target false positive rate (0 < fpr < 1)
+ * @param flags		layout (POPT_BITS_*)
+ * @return		new bit set (malloc'd), NULL on failure
+ */
+/*@only@*/ /*@null@*/
+poptBits poptBitsCreate(unsigned int n, double fpr, unsigned int flags)
+	/*@*/;
+
 /*@-exportlocal@*/
 int poptBitsAdd(/*@null@*/poptBits bits, /*@null@*/const char * s)
 	/*@modifies bits @*/;
@@ -709,7 +936,62 @@ int poptBitsChk(/*@null@*/poptBits bits, /*@null@*/const char * s)
 	/*@*/;
 int poptBitsClr(/*@null@*/poptBits bits)
 	/*@modifies bits @*/;
+/**
+ * Add strings to a bit set, hashing a batch of them ahead of their probes.
+ * @param bits		bit set
+ * @param sv		strings
+ * @param n		no. of strings
+ * @return		0 on success, POPT_ERROR_NULLARG on an empty string
+ */
+int poptBitsAddMany(/*@null@*/ poptBits bits, /*@null@*/ const char ** sv,
+		size_t n)
+	/*@modifies bits @*/;
+/**
+ * Check strings against a bit set, hashing a batch of them ahead of
+ * their probes.
+ * @param bits		bit set
+ * @param sv		strings
+ * @param n		no. of strings
+ * @retval rcs		poptBitsChk() result per string (or NULL)
+ * @return		no. of strings found, POPT_ERROR_NULLARG on an empty string
+ */
+int poptBitsChkMany(/*@null@*/ poptBits bits, /*@null@*/ const char ** sv,
+		size_t n, /*@null@*/ int * rcs)
+	/*@modifies rcs @*/;
+
+/**
+ * Add a string to a bit set that other threads are adding to (or checking)
+ * at the same time. Bits are set with atomic ORs (counters with
+ * compare-and-swap), so no thread's bits are lost.
+ * @param bits		bit set
+ * @param s		string
+ * @return		0 on success, otherwise POPT_ERROR_*
+ *			(POPT_ERROR_BADOPERATION if built without atomics)
+ */
+int poptBitsAddAtomic(/*@null@*/ poptBits bits, /*@null@*/ const char * s)
+	/*@modifies bits @*/;
+/**
+ * Check a string against a bit set that other threads are adding to.
+ * Loads are relaxed: a string is found once the thread that added it has
+ * synchronized with this one (e.g. by pthread_join), or added it itself.
+ * @param bits		bit set
+ * @param s		string
+ * @return		1 if found, 0 if not, POPT_ERROR_NULLARG on an empty string,
+ *			POPT_ERROR_BADOPERATION if built without atomics
+ */
+int poptBitsChkAtomic(/*@null@*/ poptBits bits, /*@null@*/ const char * s)
+	/*@*/;
 /*@-exportlocal@*/
+/**
+ * Delete a string from a bit set. Unless the set is POPT_BITS_COUNTING,
+ * this also clears bits that other strings share, and those then go missing.
+ * A counting set leaves a string that is not in it alone, but deleting a
+ * string that was never added and still checks present (a false positive)
+ * takes counts from other strings, and those can then go missing too.
+ * @param bits		bit set
+ * @param s		string
+ * @return		0 on success, otherwise POPT_ERROR_*
+ */
 int poptBitsDel(/*@null@*/poptBits bits, /*@null@*/const char * s)
 	/*@modifies bits @*/;
 /*@-fcnuse@*/
@@ -722,6 +1004,62 @@ int poptBitsArgs(/*@null@*/ poptContext con, /*@null@*/ poptBits * ap)
 /*@=fcnuse@*/
 /*@=exportlocal@*/
 
+/**
+ * Return the no. of bits (or non-zero counters) set in a bit set.
+ * @param bits		bit set
+ * @return		no. of bits set
+ */
+unsigned int poptBitsPopcount(/*@null@*/ poptBits bits)
+	/*@*/;
+
+/**
+ * Estimate the no. of distinct strings added to a bit set from its fill.
+ * @param bits		bit set
+ * @return		estimated count, HUGE_VAL if saturated, -1 if NULL
+ */
+double poptBitsEstimateCount(/*@null@*/ poptBits bits)
+	/*@*/;
+
+/**
+ * Save a bit set to a file (in native byte order).
+ * @param bits		bit set
+ * @param fn		file name (replaced atomically)
+ * @return		0 on success, POPT_ERROR_ERRNO on failure
+ */
+int poptBitsSave(/*@null@*/ poptBits bits, /*@null@*/ const char * fn)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies errno, fileSystem, internalState @*/;
+
+/**
+ * Load a bit set saved by poptBitsSave().
+ * @retval *bitsp	bit set (malloc'd)
+ * @param fn		file name
+ * @return		0 on success, POPT_ERROR_BADBITS/POPT_ERROR_ERRNO on failure
+ */
+int poptBitsLoad(/*@null@*/ poptBits * bitsp, /*@null@*/ const char * fn)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies *bitsp, errno, fileSystem, internalState @*/;
+
+/**
+ * Map a bit set saved by poptBitsSave() read-only, sharing the page cache.
+ * Falls back to poptBitsLoad() where mmap(2) isn't available.
+ * @retval *bitsp	bit set (free with poptBitsFree())
+ * @param fn		file name
+ * @return		0 on success, POPT_ERROR_BADBITS/POPT_ERROR_ERRNO on failure
+ */
+int poptBitsMap(/*@null@*/ poptBits * bitsp, /*@null@*/ const char * fn)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies *bitsp, errno, fileSystem, internalState @*/;
+
+/**
+ * Free (or unmap) a bit set.
+ * @param bits		bit set
+ * @return		NULL always
+ */
+/*@null@*/
+poptBits poptBitsFree(/*@only@*/ /*@null@*/ poptBits bits)
+	/*@modifies bits @*/;
+
 /**
  * Save a string into a bit set (experimental).
  * @retval *bits	bit set (lazily malloc'd if NULL)
@@ -734,7 +1072,7 @@ int poptBitsArgs(/*@null@*/ poptContext con, /*@null@*/ poptBits * ap)
 int poptSaveBits(/*@null@*/ poptBits * bitsp, unsigned int argInfo,
 		/*@null@*/ const char * s)
 	/*@globals _poptBitsN, _poptBitsM, _poptBitsK, internalState @*/
-	/*@modifies *bitsp, _poptBitsN, _poptBitsM, _poptBitsK, internalState @*/;
+	/*@modifies *bitsp, internalState @*/;
 /*@=incondefs@*/
 
 /*@=type@*/
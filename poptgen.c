@@ -0,0 +1,369 @@
+/** \ingroup popt
+ * \file popt/poptgen.c
+ * Generate a long option name matcher (a minimal perfect hash) in C.
+ */
+
+/* (C) 1998-2002 Red Hat, Inc. -- Licensing details are in the COPYING
+   file accompanying popt source distributions, available from
+   ftp://ftp.rpm.org/pub/rpm/dist. */
+
+#include "system.h"
+#include <stdio.h>
+#include <stdint.h>
+#include "popt.h"
+
+/*
+ * A description has one long option name per line, with or without the
+ * leading "--" (use "--" alone for the empty name). A name followed by
+ * "toggle" also matches its "no" and "no-" names, as POPT_ARGFLAG_TOGGLE
+ * options do. Blank lines, and lines starting with '#', are ignored.
+ *
+ * The generated matcher hashes a name once (seeded FNV-1a), selects a
+ * bucket displacement, and remixes the hash to a unique match number
+ * that is checked with a single memcmp.
+ */
+
+static const char * outfn = NULL;
+static const char * prefix = "popt";
+
+#define	GEN_MAXSEED	256
+#define	GEN_MAXDISP	(1U << 20)
+
+typedef struct genKey_s {
+    char * s;
+    size_t ns;
+    uint32_t h;
+} * genKey;
+
+static genKey keys = NULL;
+static size_t nkeys = 0;
+static size_t nbuckets = 0;
+static uint32_t * disp = NULL;
+static int * slots = NULL;
+static uint32_t seed = 0;
+
+static uint32_t genHash(const char * s, size_t ns, uint32_t hseed)
+{
+    uint32_t h = 2166136261U ^ hseed;
+    size_t i;
+
+    for (i = 0; i < ns; i++) {
+	h ^= (unsigned char) s[i];
+	h *= 16777619U;
+    }
+    return h;
+}
+
+static uint32_t genMix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+static int addKey(const char * s, size_t ns)
+{
+    size_t i;
+
+    for (i = 0; i < nkeys; i++) {
+	if (keys[i].ns == ns && !memcmp(keys[i].s, s, ns))
+	    return 0;
+    }
+    keys = realloc(keys, (nkeys + 1) * sizeof(*keys));
+    if (keys == NULL)
+	return POPT_ERROR_MALLOC;
+    keys[nkeys].s = malloc(ns + 1);
+    if (keys[nkeys].s == NULL)
+	return POPT_ERROR_MALLOC;
+    memcpy(keys[nkeys].s, s, ns);
+    keys[nkeys].s[ns] = '\0';
+    keys[nkeys].ns = ns;
+    keys[nkeys].h = 0;
+    nkeys++;
+    return 0;
+}
+
+static int loadKeys(const char * fn)
+{
+    char b[BUFSIZ];
+    FILE * fp = (strcmp(fn, "-") ? fopen(fn, "r") : stdin);
+    char * t, * te;
+    int rc = POPT_ERROR_ERRNO;
+
+    if (fp == NULL || ferror(fp)) goto exit;
+
+    rc = 0;
+    while (rc == 0 && (t = fgets(b, sizeof(b), fp)) != NULL) {
+	int toggle = 0;
+
+	while (*t && isspace((unsigned char)*t)) t++;
+	if (*t == '#') continue;
+	te = t + strlen(t);
+	while (te-- > t && isspace((unsigned char)*te)) *te = '\0';
+	if (*t == '\0') continue;
+
+	/* Split off a trailing "toggle". */
+	for (te = t; *te && !isspace((unsigned char)*te); te++)
+	    {};
+	if (*te != '\0') {
+	    *te++ = '\0';
+	    while (*te && isspace((unsigned char)*te)) te++;
+	    if (strcmp(te, "toggle")) {
+		fprintf(stderr, "poptgen: %s: unknown keyword \"%s\"\n", fn, te);
+		rc = POPT_ERROR_BADOPT;
+		break;
+	    }
+	    toggle = 1;
+	}
+	if (t[0] == '-' && t[1] == '-')
+	    t += 2;
+
+	if (toggle) {
+	    char * s = malloc(sizeof("no-") + strlen(t));
+	    if (s == NULL) {
+		rc = POPT_ERROR_MALLOC;
+		break;
+	    }
+	    /* Strip "no" or "no-" as popt does, then add all 3 names. */
+	    if (t[0] == 'n' && t[1] == 'o')
+		t += (t[2] == '-' ? 3 : 2);
+	    if (!(t[0] == 'n' && t[1] == 'o'))
+		rc = addKey(t, strlen(t));
+	    if (rc == 0 && *t != '-')
+		rc = addKey(s, (size_t)(stpcpy(stpcpy(s, "no"), t) - s));
+	    if (rc == 0)
+		rc = addKey(s, (size_t)(stpcpy(stpcpy(s, "no-"), t) - s));
+	    free(s);
+	} else
+	    rc = addKey(t, strlen(t));
+    }
+
+exit:
+    if (rc == POPT_ERROR_ERRNO)
+	fprintf(stderr, "poptgen: %s: %s\n", fn, strerror(errno));
+    if (fp && fp != stdin) (void) fclose(fp);
+    return rc;
+}
+
+/**
+ * Find bucket displacements that map every key to its own slot.
+ * @return		0 on success, -1 if this seed doesn't work
+ */
+static int genDisplace(void)
+{
+    size_t * order = calloc(nbuckets, sizeof(*order));
+    size_t * counts = calloc(nbuckets, sizeof(*counts));
+    size_t i, j, k;
+    int rc = -1;
+
+    if (order == NULL || counts == NULL) goto exit;
+
+    memset(slots, 0xff, nkeys * sizeof(*slots));
+    for (i = 0; i < nkeys; i++) {
+	keys[i].h = genHash(keys[i].s, keys[i].ns, seed);
+	counts[keys[i].h % nbuckets]++;
+	/* Keys with equal hashes can never be separated. */
+	for (j = 0; j < i; j++)
+	    if (keys[j].h == keys[i].h) goto exit;
+    }
+
+    /* Place the largest buckets first. */
+    for (i = 0; i < nbuckets; i++) {
+	order[i] = i;
+	for (j = i; j > 0 && counts[order[j - 1]] < counts[order[j]]; j--) {
+	    k = order[j]; order[j] = order[j - 1]; order[j - 1] = k;
+	}
+    }
+
+    for (i = 0; i < nbuckets; i++) {
+	size_t b = order[i];
+	uint32_t d;
+
+	disp[b] = 0;
+	if (counts[b] == 0)
+	    continue;
+	for (d = 1; d < GEN_MAXDISP; d++) {
+	    for (j = 0; j < nkeys; j++) {
+		if (keys[j].h % nbuckets != b) continue;
+		k = genMix(keys[j].h ^ d) % nkeys;
+		if (slots[k] >= 0) break;
+		slots[k] = (int) j;
+	    }
+	    if (j == nkeys)
+		break;
+	    /* Undo this bucket's placements. */
+	    for (k = 0; k < nkeys; k++) {
+		if (slots[k] >= 0 && keys[slots[k]].h % nbuckets == b)
+		    slots[k] = -1;
+	    }
+	}
+	if (d == GEN_MAXDISP)
+	    goto exit;
+	disp[b] = d;
+    }
+    rc = 0;
+
+exit:
+    if (order) free(order);
+    if (counts) free(counts);
+    return rc;
+}
+
+static void genString(FILE * fp, const char * s, size_t ns)
+{
+    size_t i;
+
+    fputc('"', fp);
+    for (i = 0; i < ns; i++) {
+	unsigned char c = (unsigned char) s[i];
+	if (isalnum(c) || strchr("-_.+/@:=,", c) != NULL)
+	    fputc(c, fp);
+	else
+	    fprintf(fp, "\\%03o", c);
+    }
+    fputc('"', fp);
+}
+
+static int genMatcher(FILE * fp, const char * fn)
+{
+    size_t i;
+
+    fprintf(fp, "/* DO NOT EDIT! GENERATED AUTOMATICALLY by poptgen from %s. */\n", fn);
+    fprintf(fp, "#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n");
+    fprintf(fp, "#include <popt.h>\n\n");
+
+    if (nkeys == 0) {
+	fprintf(fp, "static int %s_match(const char * s, size_t ns)\n{\n", prefix);
+	fprintf(fp, "    (void) s;\n    (void) ns;\n    return -1;\n}\n\n");
+	goto exit;
+    }
+
+    fprintf(fp, "static const char * const %s_keys[%lu] = {\n",
+		prefix, (unsigned long) nkeys);
+    for (i = 0; i < nkeys; i++) {
+	const genKey k = keys + slots[i];
+	fprintf(fp, "    ");
+	genString(fp, k->s, k->ns);
+	fprintf(fp, ",\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const size_t %s_lens[%lu] = {", prefix, (unsigned long) nkeys);
+    for (i = 0; i < nkeys; i++)
+	fprintf(fp, "%s%lu,", (i % 8 ? " " : "\n    "),
+		(unsigned long) keys[slots[i]].ns);
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static const uint32_t %s_disp[%lu] = {", prefix, (unsigned long) nbuckets);
+    for (i = 0; i < nbuckets; i++)
+	fprintf(fp, "%s0x%08lxU,", (i % 6 ? " " : "\n    "), (unsigned long) disp[i]);
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static int %s_match(const char * s, size_t ns)\n", prefix);
+    fprintf(fp, "{\n");
+    fprintf(fp, "    uint32_t h = 0x%08lxU;\n", (unsigned long)(2166136261U ^ seed));
+    fprintf(fp, "    size_t i;\n\n");
+    fprintf(fp, "    for (i = 0; i < ns; i++) {\n");
+    fprintf(fp, "\th ^= (unsigned char) s[i];\n");
+    fprintf(fp, "\th *= 16777619U;\n");
+    fprintf(fp, "    }\n");
+    fprintf(fp, "    h ^= %s_disp[h %% %luU];\n", prefix, (unsigned long) nbuckets);
+    fprintf(fp, "    h ^= h >> 16;\n");
+    fprintf(fp, "    h *= 0x85ebca6bU;\n");
+    fprintf(fp, "    h ^= h >> 13;\n");
+    fprintf(fp, "    h *= 0xc2b2ae35U;\n");
+    fprintf(fp, "    h ^= h >> 16;\n");
+    fprintf(fp, "    h %%= %luU;\n", (unsigned long) nkeys);
+    fprintf(fp, "    if (%s_lens[h] != ns || memcmp(%s_keys[h], s, ns))\n", prefix, prefix);
+    fprintf(fp, "\treturn -1;\n");
+    fprintf(fp, "    return (int) h;\n");
+    fprintf(fp, "}\n\n");
+
+exit:
+    fprintf(fp, "const struct poptMatcher %s_matcher = { %s_match, %lu };\n",
+		prefix, prefix, (unsigned long) nkeys);
+    return (ferror(fp) ? POPT_ERROR_ERRNO : 0);
+}
+
+static struct poptOption options[] = {
+  { "output", 'o', POPT_ARG_STRING, &outfn, 0,
+	"Write the matcher to FILE (default: stdout)", "FILE" },
+  { "prefix", 'p', POPT_ARG_STRING, &prefix, 0,
+	"Name the matcher PREFIX_matcher (default: popt)", "PREFIX" },
+
+  POPT_AUTOHELP
+  POPT_TABLEEND
+};
+
+int main(int argc, const char ** argv)
+{
+    poptContext optCon = NULL;
+    const char ** av = NULL;
+    const char * fn = "-";
+    FILE * fp = NULL;
+    int ec = 1;		/* assume failure */
+    int rc;
+
+    optCon = poptGetContext("poptgen", argc, argv, options, 0);
+    poptSetOtherOptionHelp(optCon, "[OPTION...] [DESCRIPTION...]");
+
+    while ((rc = poptGetNextOpt(optCon)) > 0)
+	{};
+    if (rc < -1) {
+	fprintf(stderr, "poptgen: %s: %s\n",
+		poptBadOption(optCon, POPT_BADOPTION_NOALIAS),
+		poptStrerror(rc));
+	goto exit;
+    }
+
+    av = poptGetArgs(optCon);
+    if (av == NULL) {
+	if (loadKeys(fn))
+	    goto exit;
+    } else
+    for (; *av; av++) {
+	fn = *av;
+	if (loadKeys(fn))
+	    goto exit;
+    }
+
+    /* Use about 2 keys per bucket, and retry with other seeds if stuck. */
+    nbuckets = nkeys / 2 + 1;
+    disp = calloc(nbuckets, sizeof(*disp));
+    slots = calloc(nkeys + 1, sizeof(*slots));
+    if (disp == NULL || slots == NULL)
+	goto exit;
+    for (seed = 0; seed < GEN_MAXSEED; seed++) {
+	if (genDisplace() == 0)
+	    break;
+    }
+    if (seed == GEN_MAXSEED) {
+	fprintf(stderr, "poptgen: no perfect hash found for %lu names\n",
+		(unsigned long) nkeys);
+	goto exit;
+    }
+
+    fp = (outfn ? fopen(outfn, "w") : stdout);
+    if (fp == NULL) {
+	fprintf(stderr, "poptgen: %s: %s\n", outfn, strerror(errno));
+	goto exit;
+    }
+    if (genMatcher(fp, fn) == 0)
+	ec = 0;
+
+exit:
+    if (fp && fp != stdout && fclose(fp) != 0)
+	ec = 1;
+    if (ec && fp && outfn)
+	(void) unlink(outfn);
+    while (nkeys > 0)
+	free(keys[--nkeys].s);
+    if (keys) free(keys);
+    if (disp) free(disp);
+    if (slots) free(slots);
+    optCon = poptFreeContext(optCon);
+    return ec;
+}
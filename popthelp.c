@@ -189,7 +189,8 @@ getArgDescrip(const struct poptOption * opt,
 
     if (poptArgType(opt) == POPT_ARG_MAINCALL)
 	return opt->argDescrip;
-    if (poptArgType(opt) == POPT_ARG_ARGV)
+    if (poptArgType(opt) == POPT_ARG_ARGV
+     || poptArgType(opt) == POPT_ARG_COUNTED_ARGV)
 	return opt->argDescrip;
 
     if (opt->argDescrip) {
@@ -220,6 +221,7 @@ getArgDescrip(const struct poptOption * opt,
     case POPT_ARG_DOUBLE:	return POPT_("DOUBLE");
     case POPT_ARG_MAINCALL:	return NULL;
     case POPT_ARG_ARGV:		return NULL;
+    case POPT_ARG_COUNTED_ARGV:	return NULL;
     default:			return POPT_("ARG");
     }
 }
@@ -278,6 +280,7 @@ assert(le);	/* XXX can't happen */
 	le += sprintf(le, "%p", opt->arg);
 	break;
     case POPT_ARG_ARGV:
+    case POPT_ARG_COUNTED_ARGV:
 	le += sprintf(le, "%p", opt->arg);
 	break;
     case POPT_ARG_STRING:
@@ -456,7 +459,8 @@ assert(t);	/* XXX can't happen */
 	    /* XXX argDescrip[0] determines "--foo=bar" or "--foo bar". */
 	    if (!strchr(" =(", argDescrip[0]))
 		*le++ = ((poptArgType(opt) == POPT_ARG_MAINCALL) ? ' ' :
-			 (poptArgType(opt) == POPT_ARG_ARGV) ? ' ' : '=');
+			 (poptArgType(opt) == POPT_ARG_ARGV) ? ' ' :
+			 (poptArgType(opt) == POPT_ARG_COUNTED_ARGV) ? ' ' : '=');
 	    le = stpcpy(leo = le, argDescrip);
 
 	    /* Adjust for (possible) wide characters. */
@@ -941,6 +945,12 @@ assert(done->opts);	/* XXX can't happen */
 
 void poptSetOtherOptionHelp(poptContext con, const char * text)
 {
+    /* A context in a caller's block keeps the text there, if it fits. */
+    if (con->block != NULL) {
+	if ((con->otherHelp = poptArenaStrdup(con->block, text)) != NULL)
+	    poptArenaMark(con->block);
+	return;
+    }
     con->otherHelp = _free(con->otherHelp);
     con->otherHelp = xstrdup(text);
 }
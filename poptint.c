@@ -205,3 +205,165 @@ POPT_fprintf (FILE * stream, const char * format, ...)
 }
 
 #endif	/* !defined(POPT_fprintf) */
+
+/**
+ * A chunk of arena memory, allocated from just after the header.
+ */
+struct poptArenaChunk_s {
+/*@only@*/ /*@null@*/
+    struct poptArenaChunk_s * next;	/*!< previous (smaller) chunk */
+    size_t size;			/*!< no. of usable bytes */
+    size_t used;			/*!< no. of used bytes */
+};
+
+#define	POPT_ARENA_DATA(_c)	\
+    ((char *)(_c) + POPT_ARENA_ROUND(sizeof(struct poptArenaChunk_s)))
+
+poptArena poptArenaNew(size_t chunkSize)
+{
+    poptArena a = (poptArena) xcalloc(1, sizeof(*a));
+
+    if (a != NULL)
+	a->chunkSize = (chunkSize > 0 ? chunkSize : 4096);
+    return a;
+}
+
+poptArena poptArenaInit(void * block, size_t blockSize)
+{
+    size_t pad = (POPT_ARENA_ALIGN - ((size_t)block % POPT_ARENA_ALIGN))
+		% POPT_ARENA_ALIGN;
+    size_t hdr = POPT_ARENA_ROUND(sizeof(struct poptArenaChunk_s));
+    struct poptArenaChunk_s * c;
+    poptArena a;
+
+    if (block == NULL || blockSize < pad + hdr + POPT_ARENA_ROUND(sizeof(*a)))
+	return NULL;
+
+    /* The block is the one and only chunk, and also holds the arena. */
+    c = (struct poptArenaChunk_s *) ((char *)block + pad);
+    c->next = NULL;
+    c->size = blockSize - pad - hdr;
+    c->used = POPT_ARENA_ROUND(sizeof(*a));
+    a = (poptArena) POPT_ARENA_DATA(c);
+    a->chunks = c;
+    a->chunkSize = 0;
+    a->total = c->used;
+    a->base = 0;
+    a->fixed = 1;
+    return a;
+}
+
+size_t poptArenaBlockSize(size_t nb)
+{
+    return (POPT_ARENA_ALIGN - 1)
+	+ POPT_ARENA_ROUND(sizeof(struct poptArenaChunk_s))
+	+ POPT_ARENA_ROUND(sizeof(struct poptArena_s))
+	+ nb;
+}
+
+void * poptArenaAlloc(poptArena a, size_t nb)
+{
+    struct poptArenaChunk_s * c = a->chunks;
+    void * p;
+
+    nb = POPT_ARENA_ROUND(nb > 0 ? nb : 1);
+    if (c == NULL || c->size - c->used < nb) {
+	/* Chunks double in size, so there are O(log n) of them. */
+	size_t size = (c != NULL ? 2 * c->size : a->chunkSize);
+
+	if (a->fixed)
+	    return NULL;
+	while (size < nb)
+	    size *= 2;
+	c = (struct poptArenaChunk_s *)
+		xmalloc(POPT_ARENA_ROUND(sizeof(*c)) + size);
+	if (c == NULL)
+	    return NULL;
+	c->next = a->chunks;
+	c->size = size;
+	c->used = 0;
+	a->chunks = c;
+    }
+    p = POPT_ARENA_DATA(c) + c->used;
+    c->used += nb;
+    a->total += nb;
+    return p;
+}
+
+void * poptArenaCalloc(poptArena a, size_t nmemb, size_t size)
+{
+    void * p = poptArenaAlloc(a, nmemb * size);
+
+    if (p != NULL)
+	memset(p, 0, nmemb * size);
+    return p;
+}
+
+void * poptArenaRealloc(poptArena a, void * p, size_t onb, size_t nb)
+{
+    struct poptArenaChunk_s * c = a->chunks;
+    void * q;
+
+    /* Grow (or shrink) the last allocation in place if possible. */
+    if (p != NULL && c != NULL
+     && (char *)p + POPT_ARENA_ROUND(onb) == POPT_ARENA_DATA(c) + c->used
+     && c->used - POPT_ARENA_ROUND(onb) + POPT_ARENA_ROUND(nb) <= c->size)
+    {
+	c->used += POPT_ARENA_ROUND(nb);
+	c->used -= POPT_ARENA_ROUND(onb);
+	a->total += POPT_ARENA_ROUND(nb);
+	a->total -= POPT_ARENA_ROUND(onb);
+	return p;
+    }
+    if (p != NULL && nb <= onb)
+	return p;
+    if ((q = poptArenaAlloc(a, nb)) != NULL && p != NULL)
+	memcpy(q, p, onb);
+    return q;
+}
+
+char * poptArenaStrdup(poptArena a, const char * s)
+{
+    size_t nb = strlen(s) + 1;
+    char * t = (char *) poptArenaAlloc(a, nb);
+
+    if (t != NULL)
+	memcpy(t, s, nb);
+    return t;
+}
+
+void poptArenaMark(poptArena a)
+{
+    if (a->fixed)
+	a->base = a->chunks->used;
+}
+
+void poptArenaReset(poptArena a)
+{
+    struct poptArenaChunk_s * c = a->chunks;
+
+    /* Keep only the newest (and largest) chunk. */
+    if (c == NULL)
+	return;
+    while (c->next != NULL) {
+	struct poptArenaChunk_s * n = c->next;
+	c->next = n->next;
+	n = _free(n);
+    }
+    c->used = a->base;
+    a->total = a->base;
+}
+
+poptArena poptArenaFree(poptArena a)
+{
+    /* A caller's block (and the arena in it) belongs to the caller. */
+    if (a != NULL && !a->fixed) {
+	while (a->chunks != NULL) {
+	    struct poptArenaChunk_s * c = a->chunks;
+	    a->chunks = c->next;
+	    c = _free(c);
+	}
+	a = _free(a);
+    }
+    return NULL;
+}
@@ -44,6 +44,21 @@ typedef struct {
 #define PBM_CLR(d, s)   (__PBM_BITS (s)[__PBM_IX (d)] &= ~__PBM_MASK (d))
 #define PBM_ISSET(d, s) ((__PBM_BITS (s)[__PBM_IX (d)] & __PBM_MASK (d)) != 0)
 
+/* Saturating 4 bit counter macros (POPT_BITS_COUNTING). */
+#define	__PCM_NCTRS		(__PBM_NBITS / 4)
+#define	__PCM_IX(c)		((c) / __PCM_NCTRS)
+#define	__PCM_SHIFT(c)		((((unsigned)(c)) % __PCM_NCTRS) * 4)
+#define	__PCM_MAX		0xfU
+#define PCM_GET(c, s)	((__PBM_BITS (s)[__PCM_IX (c)] >> __PCM_SHIFT (c)) & __PCM_MAX)
+#define PCM_INC(c, s)	(__PBM_BITS (s)[__PCM_IX (c)] += (__pbm_bits) 1 << __PCM_SHIFT (c))
+#define PCM_DEC(c, s)	(__PBM_BITS (s)[__PCM_IX (c)] -= (__pbm_bits) 1 << __PCM_SHIFT (c))
+
+/* Saved bit set identity. */
+#define	POPT_BITS_MAGIC		0x73746962U	/* "bits" */
+#define	POPT_BITS_VERSION	1U
+#define	POPT_BITS_HASH		0x33756c6aU	/* "jlu3": poptJlu32lpair() */
+#define	POPT_BITS_LAYOUT	(POPT_BITS_BLOCKED|POPT_BITS_COUNTING)
+
 extern void poptJlu32lpair(/*@null@*/ const void *key, size_t size,
                 uint32_t *pc, uint32_t *pb)
         /*@modifies *pc, *pb@*/;
@@ -105,6 +120,7 @@ struct optionStackEntry {
     int next;
 /*@only@*/ /*@null@*/
     char * nextArg;
+    int nextArgOwned;		/*!< is nextArg a copy (not borrowed)? */
 /*@observer@*/ /*@null@*/
     const char * nextCharArg;
 /*@dependent@*/ /*@null@*/
@@ -124,6 +140,269 @@ struct poptLink_s {
 #endif
 };
 
+/**
+ * A POPT_ARGFLAG_CALCULATOR instruction: push a constant, or an operator.
+ */
+typedef struct poptCalcInsn_s {
+    long long val;			/*!< constant to push (if op is '\0') */
+    int op;				/*!< operator character (or '\0') */
+} * poptCalcInsn;
+
+/**
+ * A POPT_ARGFLAG_CALCULATOR argDescrip, compiled from its RPN string.
+ */
+typedef struct poptCalc_s {
+/*@dependent@*/
+    poptCalcInsn insns;			/*!< instructions */
+    int ninsns;				/*!< no. of instructions */
+    int need;				/*!< no. of values used from below arg0 */
+    int peak;				/*!< most values pushed above arg0, arg1 */
+    int rc;				/*!< error every evaluation fails with (or 0) */
+} * poptCalc;
+
+/**
+ * A matchable option from a flattened option table, with its callback.
+ */
+typedef struct poptTableEntry_s {
+/*@observer@*/
+    const struct poptOption * opt;	/*!< the option */
+/*@null@*/
+    poptCallbackType callback;		/*!< table callback (if any) */
+/*@observer@*/ /*@null@*/
+    const void * callbackData;		/*!< callback data (if any) */
+/*@dependent@*/ /*@null@*/
+    poptCalc calc;			/*!< compiled calculator (if any) */
+} * poptTableEntry;
+
+/**
+ * A long option name that matches a flattened option.
+ */
+typedef struct poptTableKey_s {
+/*@observer@*/
+    const char * key;			/*!< long option name */
+    size_t keyLen;			/*!< length of key */
+    int entry;				/*!< option entry number */
+    int next;				/*!< next record with same key (or -1) */
+} * poptTableKey;
+
+/**
+ * A node in a path compressed trie over the sorted long option names.
+ * A node's label is its first name's bytes from its parent's depth.
+ */
+typedef struct poptTableNode_s {
+    int name;				/*!< first sorted name below node */
+    size_t depth;			/*!< name prefix length at node */
+    int child;				/*!< first child node (or -1) */
+    int sibling;			/*!< next sibling node (or -1) */
+    int entry;				/*!< entry of every name below (-1 none, -2 many) */
+} * poptTableNode;
+
+/**
+ * An option table compiled for lookup, read-only once built.
+ * Entries are kept in table traversal order, so the lowest matching
+ * entry number is the option that a recursive table walk finds first.
+ */
+struct poptCompiledTable_s {
+/*@observer@*/ /*@null@*/
+    const struct poptOption * options;	/*!< the option table */
+/*@only@*/ /*@null@*/
+    poptTableEntry entries;		/*!< flattened options */
+    int nentries;			/*!< no. of flattened options */
+/*@only@*/ /*@null@*/
+    poptTableKey keys;			/*!< long option names */
+    int nkeys;				/*!< no. of long option names */
+/*@observer@*/ /*@null@*/
+    const struct poptMatcher * matcher;	/*!< long option name matcher */
+/*@only@*/ /*@null@*/
+    int * slots;			/*!< key chains, hashed or matched (or -1) */
+    uint32_t mask;			/*!< no. of slots - 1 */
+    int shorts[UCHAR_MAX + 1];		/*!< first entry with short name (or -1) */
+/*@only@*/ /*@null@*/
+    int * names;			/*!< sorted key chain heads */
+    int nnames;				/*!< no. of distinct long option names */
+/*@only@*/ /*@null@*/
+    poptTableNode nodes;		/*!< abbreviation trie (root first) */
+    int nnodes;				/*!< no. of trie nodes */
+/*@only@*/ /*@null@*/
+    const struct poptOption ** callbacks;	/*!< table callbacks */
+    int ncallbacks;			/*!< no. of table callbacks */
+    int nmaincalls;			/*!< no. of POPT_ARG_MAINCALL options */
+/*@only@*/ /*@null@*/
+    poptCalc calcs;			/*!< compiled calculators */
+/*@only@*/ /*@null@*/
+    poptCalcInsn insns;			/*!< calculator instructions */
+/*@only@*/ /*@null@*/
+    char * strings;			/*!< toggle "no" and "no-" names */
+/*@dependent@*/ /*@null@*/
+    struct poptArena_s * arena;		/*!< arena owning the table (or NULL) */
+};
+
+/**
+ * A hashed index of alias or exec items, by long and short name.
+ * Only the last added item with a name is kept, as later items win.
+ */
+typedef struct poptItemIndex_s {
+/*@only@*/ /*@null@*/
+    int * slots;			/*!< open addressed item numbers (or -1) */
+    uint32_t mask;			/*!< no. of slots - 1 */
+    int nnames;				/*!< no. of distinct long names */
+    int shorts[UCHAR_MAX + 1];		/*!< last item with short name (or -1) */
+} * poptItemIndex;
+
+/**
+ * The size of a POPT_ARG_ARGV array, remembered between appends.
+ */
+typedef struct poptArgvSave_s {
+/*@dependent@*/
+    const char *** argvp;		/*!< address of the array */
+/*@dependent@*/ /*@null@*/
+    const char ** argv;			/*!< ... the array after the append */
+    int argc;				/*!< no. of strings */
+    int alloced;			/*!< capacity, NULL included */
+} * poptArgvSave;
+
+/**
+ * A bump allocator for parse-time memory, released all at once.
+ * A fixed arena lives in a single caller supplied block, and never grows.
+ */
+typedef struct poptArena_s {
+/*@only@*/ /*@null@*/
+    struct poptArenaChunk_s * chunks;	/*!< newest (largest) chunk first */
+    size_t chunkSize;			/*!< first chunk size */
+    size_t total;			/*!< no. of bytes allocated */
+    size_t base;			/*!< fixed arena reset point */
+    int fixed;				/*!< is arena a caller's block? */
+} * poptArena;
+
+#define	POPT_ARENA_ALIGN	(2 * sizeof(void *))
+#define	POPT_ARENA_ROUND(_nb)	\
+    (((_nb) + POPT_ARENA_ALIGN - 1) & ~(POPT_ARENA_ALIGN - 1))
+
+/**
+ * Create an arena.
+ * @param chunkSize	first chunk size (0 uses a default)
+ * @return		arena (NULL on failure)
+ */
+/*@only@*/ /*@null@*/
+poptArena poptArenaNew(size_t chunkSize)
+	/*@*/;
+
+/**
+ * Create a fixed arena in a caller supplied block.
+ * @param block		memory block
+ * @param blockSize	memory block size
+ * @return		arena (NULL if the block is too small)
+ */
+/*@dependent@*/ /*@null@*/
+poptArena poptArenaInit(/*@null@*/ void * block, size_t blockSize)
+	/*@modifies block @*/;
+
+/**
+ * Return the block size a fixed arena needs for some (rounded) allocations.
+ * @param nb		no. of bytes, the sum of POPT_ARENA_ROUND() sizes
+ * @return		block size
+ */
+size_t poptArenaBlockSize(size_t nb)
+	/*@*/;
+
+/**
+ * Allocate memory from an arena.
+ * @param a		arena
+ * @param nb		no. of bytes
+ * @return		aligned memory (NULL on failure)
+ */
+/*@null@*/
+void * poptArenaAlloc(poptArena a, size_t nb)
+	/*@modifies a @*/;
+
+/**
+ * Allocate zeroed memory from an arena.
+ * @param a		arena
+ * @param nmemb		no. of members
+ * @param size		member size
+ * @return		aligned memory (NULL on failure)
+ */
+/*@null@*/
+void * poptArenaCalloc(poptArena a, size_t nmemb, size_t size)
+	/*@modifies a @*/;
+
+/**
+ * Resize memory allocated from an arena.
+ * @param a		arena
+ * @param p		memory (NULL allocates)
+ * @param onb		old no. of bytes
+ * @param nb		new no. of bytes
+ * @return		resized memory (NULL on failure)
+ */
+/*@null@*/
+void * poptArenaRealloc(poptArena a, /*@null@*/ void * p, size_t onb, size_t nb)
+	/*@modifies a @*/;
+
+/**
+ * Duplicate a string into an arena.
+ * @param a		arena
+ * @param s		string
+ * @return		string copy (NULL on failure)
+ */
+/*@null@*/
+char * poptArenaStrdup(poptArena a, const char * s)
+	/*@modifies a @*/;
+
+/**
+ * Keep what is allocated from a fixed arena so far across resets.
+ * @param a		arena
+ */
+void poptArenaMark(poptArena a)
+	/*@modifies a @*/;
+
+/**
+ * Release all memory allocated from an arena, keeping its largest chunk.
+ * A fixed arena is released back to its mark.
+ * @param a		arena
+ */
+void poptArenaReset(poptArena a)
+	/*@modifies a @*/;
+
+/**
+ * Destroy an arena.
+ * @param a		arena
+ * @return		NULL always
+ */
+/*@null@*/
+poptArena poptArenaFree(/*@only@*/ /*@null@*/ poptArena a)
+	/*@modifies a @*/;
+
+/**
+ * An alias argv, compiled into its "!#:+" substitution slots.
+ */
+typedef struct poptArgTemplate_s {
+    size_t * lens;		/*!< argv string lengths */
+    size_t * slots;		/*!< "!#:+" offsets, in argv string order */
+    int * first;		/*!< first slot of each argv string (argc + 1) */
+} * poptArgTemplate;
+
+/**
+ * An option seen while parsing, from which an exec's argv is built.
+ */
+typedef struct poptAvItem_s {
+/*@dependent@*/ /*@null@*/
+    const struct poptOption * opt;	/*!< option (NULL for an exec item) */
+    int exec;				/*!< exec item (execs move as they grow) */
+/*@only@*/ /*@null@*/
+    const char * arg;			/*!< option argument copy (or NULL) */
+    char shortName;			/*!< short name seen (long name if '\0') */
+} * poptAvItem;
+
+/**
+ * The header in front of a POPT_ARG_COUNTED_ARGV array.
+ */
+typedef struct poptArgvHdr_s {
+    size_t count;			/*!< no. of strings (less NULL) */
+    size_t alloced;			/*!< no. of slots (including NULL) */
+} * poptArgvHdr;
+
+#define	POPT_ARGV_HDR(_av)	((poptArgvHdr)(void *)(_av) - 1)
+
 #define	POPTINT_OPTION_DEPTH	10
 #define	POPTINT_CALC_DEPTH	20	/* XXX overkill */
 
@@ -134,36 +413,63 @@ struct poptContext_s {
     struct optionStackEntry * os;
     size_t optionDepth;
 
-#ifdef	SUPPORT_GLOBAL_CALCULATOR
-    int64_t calcStack[POPTINT_CALC_DEPTH];
-    int64_t * stk;
+    long long calcStack[POPTINT_CALC_DEPTH + 1];	/*!< (+1 'r' scratch slot) */
+    long long * stk;			/*!< calculator stack top */
     size_t calcDepth;
-#endif
+/*@dependent@*/ /*@null@*/
+    const void * calcArg;		/*!< variable the stack top was saved to */
 
 /*@owned@*/ /*@null@*/
     poptArgv leftovers;
     int numLeftovers;
     int nextLeftover;
+    int maxLeftovers;			/*!< leftovers capacity (less NULL) */
 /*@keep@*/
     const struct poptOption * options;
+/*@dependent@*/
+    poptCompiledTable table;
+/*@only@*/ /*@null@*/
+    poptCompiledTable privateTable;	/*!< table compiled by poptGetContext */
     int restLeftover;
 /*@only@*/ /*@null@*/
     const char * appName;
 /*@only@*/ /*@null@*/
     poptItem aliases;
     int numAliases;
+    int maxAliases;			/*!< aliases (and templates) capacity */
+/*@only@*/ /*@null@*/
+    poptArgTemplate * aliasTemplates;	/*!< compiled argv of each alias */
+/*@only@*/ /*@null@*/
+    poptItemIndex aliasIndex;
     unsigned int flags;
+    __pbm_bits itemShorts[__PBM_IX(UCHAR_MAX) + 1];	/*!< alias/exec short names */
 /*@owned@*/ /*@null@*/
     poptItem execs;
     size_t numExecs;
+    size_t maxExecs;			/*!< execs capacity */
+/*@only@*/ /*@null@*/
+    poptItemIndex execIndex;
+/*@only@*/ /*@null@*/
+    poptArgv kept;		/*!< copies that borrowed arguments point to */
+    size_t nkept;
+    size_t maxkept;
 /*@only@*/ /*@null@*/
-    poptArgv av;
+    poptArgvSave saves;		/*!< POPT_ARG_ARGV arrays appended to */
+    size_t nsaves;
+    size_t maxsaves;
+/*@only@*/ /*@null@*/
+    poptAvItem av;		/*!< options seen, for an exec or main call */
     size_t ac;
     size_t nav;
+/*@only@*/ /*@null@*/
+    poptArena arena;		/*!< parse-time memory (if POPT_CONTEXT_ARENA) */
+/*@dependent@*/ /*@null@*/
+    poptArena block;		/*!< caller's block holding the context (or NULL) */
 /*@null@*/
     int (*maincall) (int argc, const char **argv);
+    int doExec;			/*!< exec item to run (or -1) */
 /*@dependent@*/ /*@null@*/
-    poptItem doExec;
+    poptCalc calc;		/*!< compiled calculator of the option found */
 /*@only@*/ /*@null@*/
     const char * execPath;
     int execAbsolute;
@@ -122,7 +122,8 @@ assert(te);	/* XXX can't happen */
 	    if (*argv[argc] != '\0') {
 		*te++ = '\0', argc++;
 		if (argc == argvAlloced) {
-		    argvAlloced += POPT_ARGV_ARRAY_GROW_DELTA;
+		    /* Double the array, appends are amortized O(1). */
+		    argvAlloced *= 2;
 		    argv = (const char**) xrealloc(argv, sizeof(*argv) * argvAlloced);
 assert(argv);	/* XXX can't happen */
 		    if (argv == NULL) goto exit;
@@ -176,6 +177,7 @@ int poptConfigFileToString(FILE *fp, char ** argstrp,
     char * x;
     size_t t;
     size_t argvlen = 0;
+    size_t nb = 0;		/* strlen(argstr) */
     size_t maxargvlen = (size_t)480;
 
     if (argstrp)
@@ -225,13 +227,13 @@ assert(argstr);	/* XXX can't happen */
 	    q[-1] = '\0';		/* kill off newline from fgets() call */
 	    argvlen += (t = (size_t)(q - l)) + (sizeof(" --")-1);
 	    if (argvlen >= maxargvlen) {
-		maxargvlen = (t > maxargvlen) ? t*2 : maxargvlen*2;
+		while (argvlen >= maxargvlen)
+		    maxargvlen *= 2;
 		argstr = (char*) xrealloc(argstr, maxargvlen);
 assert(argstr);	/* XXX can't happen */
 		if (argstr == NULL) return POPT_ERROR_MALLOC;
 	    }
-	    strcat(argstr, " --");	/* XXX stpcpy */
-	    strcat(argstr, l);		/* XXX stpcpy */
+	    nb = (size_t) (stpcpy(stpcpy(argstr + nb, " --"), l) - argstr);
 	    continue;
 	}
 	if (*q != '=')
@@ -255,16 +257,19 @@ assert(argstr);	/* XXX can't happen */
 	t = (size_t)(x - l);
 	argvlen += t + (sizeof("' --='")-1);
 	if (argvlen >= maxargvlen) {
-	    maxargvlen = (t > maxargvlen) ? t*2 : maxargvlen*2;
+	    while (argvlen >= maxargvlen)
+		maxargvlen *= 2;
 	    argstr = (char*) xrealloc(argstr, maxargvlen);
 assert(argstr);	/* XXX can't happen */
 	    if (argstr == NULL) return POPT_ERROR_MALLOC;
 	}
-	strcat(argstr, " --");	/* XXX stpcpy */
-	strcat(argstr, l);	/* XXX stpcpy */
-	strcat(argstr, "=\"");	/* XXX stpcpy */
-	strcat(argstr, q);	/* XXX stpcpy */
-	strcat(argstr, "\"");	/* XXX stpcpy */
+	/* Append at the tracked end, strcat(3) would rescan argstr. */
+	x = stpcpy(argstr + nb, " --");
+	x = stpcpy(x, l);
+	x = stpcpy(x, "=\"");
+	x = stpcpy(x, q);
+	x = stpcpy(x, "\"");
+	nb = (size_t) (x - argstr);
     }
 
     *argstrp = argstr;
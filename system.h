@@ -49,6 +49,11 @@ char *alloca ();
 #include <fcntl.h>
 #include <limits.h>
 
+/* Only Windows translates line endings in read(2)/write(2). */
+#if !defined(O_BINARY)
+#define O_BINARY 0
+#endif
+
 #ifdef HAVE_MCHECK_H
 #include <mcheck.h>
 #endif
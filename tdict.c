@@ -1,18 +1,27 @@
 #include "system.h"
 #include <stdio.h>
+#include <time.h>
 #include "popt.h"
 
 static int _debug = 0;
 static int _verbose = 1;
+static int _bench = 0;
+static int _check = 0;
+static unsigned int bitsFlags = 0;
+static double fpr = 0.001;
 static const char * dictfn = "/usr/share/dict/words";
+static const char * mapfn = NULL;
+static const char * savefn = NULL;
+static const char * unloadfn = NULL;
 static poptBits dictbits = NULL;
+static const char ** dictwords = NULL;
 static struct {
     unsigned total;
     unsigned hits;
     unsigned misses;
 } e;
 
-static int loadDict(const char * fn, poptBits * ap)
+static int loadDict(const char * fn, poptBits * ap, const char *** wordsp)
 {
     char b[BUFSIZ];
     size_t nb = sizeof(b);
@@ -34,6 +43,8 @@ if (_debug)
 fprintf(stderr, "==> poptSaveBits(%p, \"%s\")\n", *ap, t);
 	    (void) poptSaveBits(ap, 0, t);
 	}
+	if (wordsp)
+	    (void) poptSaveCountedArgv(wordsp, 0, t);
 	nlines++;
     }
 exit:
@@ -41,9 +52,260 @@ exit:
     return nlines;
 }
 
+/*
+ * Delete every word in a file with poptBitsDel directly: unlike a "!word"
+ * line, which poptSaveBits deletes only if it checks present, nothing here
+ * guards the filter against words that were never added.
+ */
+static int unloadDict(const char * fn, poptBits bits)
+{
+    char b[BUFSIZ];
+    FILE * fp = fopen(fn, "r");
+    char * t, *te;
+    int nlines = -1;
+
+    if (fp == NULL || ferror(fp)) goto exit;
+
+    nlines = 0;
+    while ((t = fgets(b, sizeof(b), fp)) != NULL) {
+	while (*t && isspace(*t)) t++;
+	te = t + strlen(t);
+	while (te-- > t && isspace(*te)) *te = '\0';
+	if (*t == '\0') continue;
+	if (poptBitsDel(bits, t) != 0) {
+	    nlines = -1;
+	    break;
+	}
+	nlines++;
+    }
+exit:
+    if (fp) (void) fclose(fp);
+    return nlines;
+}
+
+static double now(void)
+{
+    return (double)clock() / (double)CLOCKS_PER_SEC;
+}
+
+/*
+ * Look up every dictionary word (all present), then every word with a
+ * trailing blank, which loadDict trims so none can be present: each hit
+ * there is a false positive.
+ */
+static void benchDict(poptBits bits, const char ** words)
+{
+    int nwords = poptArgvCount(words);
+    const char ** absent = (const char **) calloc(nwords + 1, sizeof(*absent));
+    unsigned nfp = 0;
+    unsigned nfn = 0;
+    int nhits;
+    double tmany;
+    double t;
+    int i;
+
+    if (absent == NULL)
+	return;
+    for (i = 0; i < nwords; i++) {
+	size_t nb = strlen(words[i]);
+	char * t = (char *) malloc(nb + 2);
+	if (t == NULL)
+	    break;
+	memcpy(t, words[i], nb);
+	t[nb] = ' ';
+	t[nb+1] = '\0';
+	absent[i] = t;
+    }
+    nwords = i;
+
+    t = now();
+    for (i = 0; i < nwords; i++)
+	if (poptBitsChk(bits, words[i]) <= 0)
+	    nfn++;
+    for (i = 0; i < nwords; i++)
+	if (poptBitsChk(bits, absent[i]) > 0)
+	    nfp++;
+    t = now() - t;
+
+    tmany = now();
+    nhits = poptBitsChkMany(bits, words, nwords, NULL);
+    nhits += poptBitsChkMany(bits, absent, nwords, NULL);
+    tmany = now() - tmany;
+
+    fprintf(stdout, "===== %s%s N:%u M:%u K:%u (%uKb)\n",
+	(bits->flags & POPT_BITS_BLOCKED ? "blocked" : "classic"),
+	(bits->flags & POPT_BITS_COUNTING ? " counting" : ""),
+	bits->N, bits->M, bits->K,
+	(((bits->M / (bits->flags & POPT_BITS_COUNTING ? 2 : 8)) + 1) + 1023) / 1024);
+    fprintf(stdout, "bits set(%u/%u) = %.4f estimated words(%.0f)\n",
+	poptBitsPopcount(bits), bits->M,
+	(double)poptBitsPopcount(bits) / bits->M, poptBitsEstimateCount(bits));
+    fprintf(stdout, "false positives(%u/%d) = %.4f false negatives(%u)\n",
+	nfp, nwords, (nwords ? (double)nfp / nwords : 0.0), nfn);
+    fprintf(stdout, "%d queries in %.3fs = %.2f Mqueries/s\n",
+	2 * nwords, t, (t > 0.0 ? (2.0 * nwords) / t / 1e6 : 0.0));
+    fprintf(stdout, "%d batched queries in %.3fs = %.2f Mqueries/s%s\n",
+	2 * nwords, tmany, (tmany > 0.0 ? (2.0 * nwords) / tmany / 1e6 : 0.0),
+	(nhits == (int)(nwords - nfn + nfp) ? "" : " (MISMATCH)"));
+
+    for (i = 0; i < nwords; i++)
+	free((void *)absent[i]);
+    free(absent);
+}
+
+/* No. of words in a bit set. */
+static size_t bitsNW(poptBits bits)
+{
+    return (size_t) (bits->M - 1) / (bits->flags & POPT_BITS_COUNTING ? 8 : 32) + 1;
+}
+
+/* Count the set bits (or non-zero counters) one at a time. */
+static unsigned countBits(poptBits bits)
+{
+    size_t nw = bitsNW(bits);
+    unsigned n = 0;
+    size_t i;
+    unsigned j;
+
+    for (i = 0; i < nw; i++) {
+	if (bits->flags & POPT_BITS_COUNTING) {
+	    for (j = 0; j < 32; j += 4)
+		n += (((bits->bits[i] >> j) & 0xf) != 0);
+	} else {
+	    for (j = 0; j < 32; j++)
+		n += ((bits->bits[i] >> j) & 1);
+	}
+    }
+    return n;
+}
+
+/*
+ * Intersect (or union) two sets' words one bit (or counter) at a time.
+ * Returns 1 if any bits are set in the result.
+ */
+static int mergeBits(unsigned * w, poptBits a, poptBits b, int intersect)
+{
+    size_t nw = bitsNW(a);
+    int rc = 0;
+    size_t i;
+    unsigned j;
+
+    for (i = 0; i < nw; i++) {
+	unsigned x = a->bits[i];
+	unsigned y = b->bits[i];
+	if (a->flags & POPT_BITS_COUNTING) {
+	    w[i] = 0;
+	    for (j = 0; j < 32; j += 4) {
+		unsigned u = (x >> j) & 0xf;
+		unsigned v = (y >> j) & 0xf;
+		if (intersect)
+		    u = (u < v ? u : v);
+		else
+		    u = (u + v > 0xf || u == 0xf || v == 0xf ? 0xf : u + v);
+		w[i] |= u << j;
+	    }
+	} else
+	    w[i] = (intersect ? (x & y) : (x | y));
+	rc |= (w[i] != 0);
+    }
+    return rc;
+}
+
+/*
+ * Fill sets with the first 1, 2, ... n dictionary words (so the no. of
+ * words of bits is not always a multiple of 4), and check poptBitsPopcount,
+ * poptBitsUnion and poptBitsIntersect of the even and odd words against
+ * a bit at a time, and poptBitsEstimateCount to within n/4 + 1 words.
+ */
+static void checkDict(poptBits bits, const char ** words)
+{
+    int nwords = poptArgvCount(words);
+    unsigned * w = NULL;
+    unsigned epop = 0, eunion = 0, eintersect = 0, eestimate = 0;
+    size_t minnw = 0, maxnw = 0;
+    int n;
+
+    for (n = 1; n <= nwords; n++) {
+	poptBits all = poptBitsCreate((unsigned) n, fpr, bitsFlags);
+	poptBits even = poptBitsCreate((unsigned) n, fpr, bitsFlags);
+	poptBits odd = poptBitsCreate((unsigned) n, fpr, bitsFlags);
+	poptBits U = NULL;
+	poptBits I = NULL;
+	size_t nw;
+	double d;
+	int i;
+
+	if (all == NULL || even == NULL || odd == NULL
+	 || (w = (unsigned *) realloc(w, bitsNW(all) * sizeof(*w))) == NULL)
+	{
+	    fprintf(stderr, "tdict: out of memory\n");
+	    exit(2);
+	}
+	nw = bitsNW(all);
+	if (minnw == 0 || nw < minnw) minnw = nw;
+	if (nw > maxnw) maxnw = nw;
+
+	for (i = 0; i < n; i++) {
+	    (void) poptBitsAdd(all, words[i]);
+	    (void) poptBitsAdd((i % 2 ? odd : even), words[i]);
+	}
+
+	if (poptBitsPopcount(all) != countBits(all))
+	    epop++;
+
+	(void) poptBitsUnion(&U, even);
+	if (poptBitsUnion(&U, odd) != mergeBits(w, even, odd, 0)
+	 || memcmp(U->bits, w, nw * sizeof(*w)))
+	    eunion++;
+	(void) poptBitsUnion(&I, even);
+	if (poptBitsIntersect(&I, odd) != mergeBits(w, even, odd, 1)
+	 || memcmp(I->bits, w, nw * sizeof(*w)))
+	    eintersect++;
+
+	d = poptBitsEstimateCount(all) - n;
+	if (d < 0.0) d = -d;
+	if (d > n / 4.0 + 1.0)
+	    eestimate++;
+
+	all = poptBitsFree(all);
+	even = poptBitsFree(even);
+	odd = poptBitsFree(odd);
+	U = poptBitsFree(U);
+	I = poptBitsFree(I);
+    }
+    free(w);
+
+    fprintf(stdout, "===== %s%s sets of 1 to %d words in %u to %u words of bits\n",
+	(bitsFlags & POPT_BITS_BLOCKED ? "blocked" : "classic"),
+	(bitsFlags & POPT_BITS_COUNTING ? " counting" : ""),
+	nwords, (unsigned) minnw, (unsigned) maxnw);
+    fprintf(stdout, "errors: popcount(%u) union(%u) intersect(%u) estimate(%u)\n",
+	epop, eunion, eintersect, eestimate);
+    fprintf(stdout, "bits set(%u/%u) estimated words(%.1f)\n",
+	poptBitsPopcount(bits), bits->M, poptBitsEstimateCount(bits));
+}
+
 static struct poptOption options[] = {
+  { "blocked", 'b', POPT_BIT_SET, &bitsFlags, POPT_BITS_BLOCKED,
+        "Keep all the bits of a word in one cache line.", NULL },
+  { "bench", '\0', POPT_ARG_VAL, &_bench, 1,
+        "Measure lookup rate and false positives.", NULL },
+  { "counting", 'c', POPT_BIT_SET, &bitsFlags, POPT_BITS_COUNTING,
+        "Count bits, so that words can be deleted.", NULL },
+  { "check", '\0', POPT_ARG_VAL, &_check, 1,
+        "Check counts and set operations bit by bit.", NULL },
   { "debug", 'd', POPT_BIT_SET|POPT_ARGFLAG_TOGGLE, &_debug, 1,
         "Set debugging.", NULL },
+  { "dict", 'D', POPT_ARG_STRING, &dictfn, 0,
+        "Dictionary to load.", "FILE" },
+  { "fp", 'p', POPT_ARG_DOUBLE, &fpr, 0,
+        "Target false positive rate.", "RATE" },
+  { "map", 'M', POPT_ARG_STRING, &mapfn, 0,
+        "Use a saved filter instead of loading the dictionary.", "FILE" },
+  { "save", 'S', POPT_ARG_STRING, &savefn, 0,
+        "Save the dictionary filter.", "FILE" },
+  { "unload", 'U', POPT_ARG_STRING, &unloadfn, 0,
+        "Delete the words in FILE from the filter.", "FILE" },
   { "verbose", 'v', POPT_BIT_SET|POPT_ARGFLAG_TOGGLE, &_verbose, 0,
         "Set verbosity.", NULL },
 
@@ -64,13 +326,6 @@ int main(int argc, const char ** argv)
     mtrace();   /* Trace malloc only if MALLOC_TRACE=mtrace-output-file. */
 #endif
 
-    /* XXX Scale the Bloom filters in popt. */
-    if ((rc = loadDict(dictfn, NULL)) <= 0)
-	goto exit;
-    _poptBitsK = 2;
-    _poptBitsM = 0;
-    _poptBitsN = _poptBitsK * rc;
-
     optCon = poptGetContext("tdict", argc, argv, options, 0);
 
     /* Read all the options (if any). */
@@ -88,8 +343,48 @@ int main(int argc, const char ** argv)
 	goto exit;
     }
 
-    if ((rc = loadDict(dictfn, &dictbits)) <= 0)
+    if (mapfn) {
+	/* Query a saved filter in place. */
+	if ((rc = poptBitsMap(&dictbits, mapfn)) != 0) {
+	    fprintf(stderr, "tdict: %s: %s\n", mapfn, (rc == POPT_ERROR_ERRNO
+			? strerror(errno) : poptStrerror(rc)));
+	    goto exit;
+	}
+	/* An empty set hashed like the dictionary's. */
+	(void) poptBitsIntersect(&avbits, dictbits);
+	if (_bench && (rc = loadDict(dictfn, NULL, &dictwords)) <= 0)
+	    goto exit;
+	dictfn = mapfn;
+    } else {
+	/* Size the Bloom filters for the dictionary. */
+	if ((rc = loadDict(dictfn, NULL, NULL)) <= 0)
+	    goto exit;
+	dictbits = poptBitsCreate((unsigned) rc, fpr, bitsFlags);
+	avbits = poptBitsCreate((unsigned) rc, fpr, bitsFlags);
+	if (dictbits == NULL || avbits == NULL) {
+	    fprintf(stderr, "tdict: can't create a %d word filter with --fp %g\n",
+		rc, fpr);
+	    rc = -1;
+	    goto exit;
+	}
+	if ((rc = loadDict(dictfn, &dictbits,
+		(_bench || _check ? &dictwords : NULL))) <= 0)
+	    goto exit;
+    }
+    if (unloadfn && (rc = unloadDict(unloadfn, dictbits)) < 0) {
+	fprintf(stderr, "tdict: %s: can't delete words\n", unloadfn);
+	goto exit;
+    }
+    if (savefn && (rc = poptBitsSave(dictbits, savefn)) != 0) {
+	fprintf(stderr, "tdict: %s: %s\n", savefn, (rc == POPT_ERROR_ERRNO
+			? strerror(errno) : poptStrerror(rc)));
 	goto exit;
+    }
+    if (_bench)
+	benchDict(dictbits, dictwords);
+    if (_check && !mapfn)
+	checkDict(dictbits, dictwords);
+    dictwords = poptFreeArgv(dictwords);
 
     av = poptGetArgs(optCon);
     if ((rc = poptBitsArgs(optCon, &avbits)) != 0)
@@ -99,7 +394,7 @@ int main(int argc, const char ** argv)
 	(void) poptBitsUnion(&Ibits, dictbits);
 	rc = poptBitsIntersect(&Ibits, avbits);
 	fprintf(stdout, "===== %s words are in %s\n", (rc ? "Some" : "No"), dictfn);
-	if (Ibits) free(Ibits);
+	Ibits = poptBitsFree(Ibits);
     }
     if (av && avbits)
     while (*av) {
@@ -123,13 +418,14 @@ int main(int argc, const char ** argv)
 exit:
     /* XXX : depends on the /usr/share/dict/words contents so no default*/
    if (rc >= 0) {
-    if (_debug) {
+    if (_debug && dictbits) {
     fprintf(stdout, "===== poptBits N:%u M:%u K:%u (%uKb) ",
-	_poptBitsN, _poptBitsM, _poptBitsK, (((_poptBitsM/8)+1)+1023)/1024);
+	dictbits->N, dictbits->M, dictbits->K, (((dictbits->M/8)+1)+1023)/1024);
     }
     fprintf(stdout, "total(%u) = hits(%u) + misses(%u)\n", e.total, e.hits, e.misses);
    }
-    if (avbits) free(avbits);
+    avbits = poptBitsFree(avbits);
+    dictbits = poptBitsFree(dictbits);
     optCon = poptFreeContext(optCon);
 #if defined(HAVE_MCHECK_H) && defined(HAVE_MTRACE)
     muntrace();   /* Trace malloc only if MALLOC_TRACE=mtrace-output-file. */
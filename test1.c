@@ -3,6 +3,9 @@
    ftp://ftp.rpm.org/pub/rpm/dist. */
 
 #include "system.h"
+#if defined(HAVE_LOCALE_H)
+#include <locale.h>
+#endif
 
 /*@unchecked@*/
 static int pass2 = 0;
@@ -70,6 +73,8 @@ static int bCounter = 34543;
 /*@unchecked@*/ /*@only@*/ /*@null@*/
 static const char ** aArgv = NULL;
 /*@unchecked@*/ /*@only@*/ /*@null@*/
+static const char ** cArgv = NULL;
+/*@unchecked@*/ /*@only@*/ /*@null@*/
 static void * aBits = NULL;
 /*@unchecked@*/ /*@observer@*/
 static const char *attributes[] = {
@@ -80,6 +85,8 @@ static size_t nattributes = (sizeof(attributes) / sizeof(attributes[0]));
 
 /*@unchecked@*/ /*@null@*/
 static char * oStr = (char *) -1;
+/*@unchecked@*/ /*@observer@*/ /*@null@*/
+static char * bStr = NULL;
 /*@unchecked@*/
 static int singleDash = 0;
 
@@ -138,6 +145,8 @@ static struct poptOption options[] = {
 	NULL },
   { "optional", '\0', POPT_ARG_STRING | POPT_ARGFLAG_OPTIONAL, &oStr, 0,
 	"POPT_ARGFLAG_OPTIONAL: Takes an optional string argument", NULL },
+  { "borrow", '\0', POPT_ARG_STRING | POPT_ARGFLAG_BORROW | POPT_ARGFLAG_DOC_HIDDEN,
+	&bStr, 0, "POPT_ARGFLAG_BORROW: A borrowed string argument", NULL },
 
   { "val", '\0', POPT_ARG_VAL | POPT_ARGFLAG_SHOW_DEFAULT, &aVal, 125992,
 	"POPT_ARG_VAL: 125992 141421", 0},
@@ -166,6 +175,8 @@ static struct poptOption options[] = {
 
    { "argv", '\0', POPT_ARG_ARGV, &aArgv, 0,
 	"POPT_ARG_ARGV: append string to argv array (can be used multiple times)","STRING"},
+   { "cargv", '\0', POPT_ARG_COUNTED_ARGV|POPT_ARGFLAG_DOC_HIDDEN, &cArgv, 0,
+	"POPT_ARG_COUNTED_ARGV: append string to counted argv array","STRING"},
    { "bits", '\0', POPT_ARG_BITSET|POPT_ARGFLAG_DOC_HIDDEN, &aBits, 0,
 	"POPT_ARG_BITSET: add string to bit set (can be used multiple times)","STRING"},
 
@@ -177,6 +188,12 @@ static struct poptOption options[] = {
 	"POPT_ARGFLAG_CALCULATOR: add a value to a counter", "P 24 +" },
    { "sub", '\0', POPT_ARG_VAL|POPT_ARGFLAG_NOT|POPT_ARGFLAG_CALCULATOR|POPT_ARGFLAG_DOC_HIDDEN, &aCounter, 24,
 	"POPT_ARGFLAG_CALCULATOR: subtract a value from a counter", "P 24 -" },
+   { "scale", '\0', POPT_ARG_INT|POPT_ARGFLAG_CALCULATOR|POPT_ARGFLAG_DOC_HIDDEN, &aCounter, 0,
+	"POPT_ARGFLAG_CALCULATOR: add ten times a value to a counter", "10 * +" },
+   { "mark", '\0', POPT_ARG_INT|POPT_ARGFLAG_CALCULATOR|POPT_ARGFLAG_DOC_HIDDEN, &aCounter, 0,
+	"POPT_ARGFLAG_CALCULATOR: leave a value on the stack", "r" },
+   { "sum", '\0', POPT_ARG_VAL|POPT_ARGFLAG_CALCULATOR|POPT_ARGFLAG_DOC_HIDDEN, &aCounter, 1,
+	"POPT_ARGFLAG_CALCULATOR: increment, and add a value left on the stack", "+ +" },
 
   { "bitset", '\0', POPT_BIT_SET | POPT_ARGFLAG_TOGGLE | POPT_ARGFLAG_SHOW_DEFAULT, &aFlag, 0x7777,
 	"POPT_BIT_SET: |= 0x7777", 0},
@@ -204,10 +221,10 @@ static struct poptOption options[] = {
 static void resetVars(void)
 	/*@globals arg1, arg2, arg3, inc, shortopt,
 		aVal, aFlag, aShort, aInt, aLong, aLongLong, aFloat, aDouble,
-		aArgv, aBits, oStr, singleDash, pass2 @*/
+		aArgv, cArgv, aBits, oStr, bStr, singleDash, pass2 @*/
 	/*@modifies arg1, arg2, arg3, inc, shortopt,
 		aVal, aFlag, aShort, aInt, aLong, aLongLong, aFloat, aDouble,
-		aArgv, aBits, oStr, singleDash, pass2 @*/
+		aArgv, cArgv, aBits, oStr, bStr, singleDash, pass2 @*/
 {
     arg1 = 0;
     arg2 = "(none)";
@@ -237,15 +254,20 @@ static void resetVars(void)
 	free(aArgv);
 	aArgv = NULL;
     }
+    cArgv = poptFreeArgv(cArgv);
     if (aBits)
 	(void) poptBitsClr(aBits);
 
     oStr = (char *) -1;
+    bStr = NULL;
 
     singleDash = 0;
     pass2 = 0;
 }
 
+/* The test1.opts long option matcher, generated by poptgen. */
+extern const struct poptMatcher test1_matcher;
+
 int main(int argc, const char ** argv)
 	/*@globals pass2, fileSystem, internalState @*/
 	/*@modifies pass2, fileSystem, internalState @*/
@@ -253,6 +275,12 @@ int main(int argc, const char ** argv)
     int rc;
     int ec = 0;
     poptContext optCon;
+    poptCompiledTable optTable = NULL;
+    unsigned int flags = 0;
+    void * block = NULL;
+    char * env;
+    int rebind = (getenv("TEST1_REBIND") != NULL);
+    int nargc = (rebind ? 1 : argc);
     const char ** rest;
     int help = 0;
     int usage = 0;
@@ -268,7 +296,55 @@ int main(int argc, const char ** argv)
     resetVars();
 /*@=modobserver@*/
 /*@-temptrans@*/
-    optCon = poptGetContext("test1", argc, argv, options, 0);
+#if defined(HAVE_LOCALE_H)
+    /* Use another locale's decimal point when testit.sh asks. */
+    if ((env = getenv("TEST1_LOCALE")) != NULL)
+	(void) setlocale(LC_NUMERIC, env);
+#endif
+
+    /* Accept unique long option prefixes when testit.sh asks. */
+    if (getenv("TEST1_ABBREV") != NULL)
+	flags |= POPT_CONTEXT_ALLOW_ABBREV;
+
+    /* Parse with a context arena when testit.sh asks. */
+    if (getenv("TEST1_ARENA") != NULL)
+	flags |= POPT_CONTEXT_ARENA;
+
+    /* Parse in a malloc-free block (half as large if "small") if asked. */
+    if ((env = getenv("TEST1_BLOCK")) != NULL) {
+	size_t nb = poptContextBlockSize(argc, options);
+	if (!strcmp(env, "small"))
+	    nb /= 2;
+	else
+	    nb += 16384;	/* room for the test-poptrc aliases */
+	block = malloc(nb);
+	rc = poptGetContextBlock(&optCon, "test1", argc, argv, options, flags,
+		block, nb);
+	if (rc) {
+	    fprintf(stderr, "test1: %s\n", poptStrerror(rc));
+	    free(block);
+	    exit(EXIT_FAILURE);
+	}
+    } else
+    /* Parse through a table compiled ahead of the context if asked. */
+    if (getenv("TEST1_COMPILED") != NULL) {
+	optTable = poptCompileTable(options);
+	if (optTable == NULL) {
+	    fprintf(stderr, "test1: can't compile the option tables\n");
+	    exit(EXIT_FAILURE);
+	}
+	optCon = poptGetCompiledContext("test1", argc, argv, optTable, flags);
+    } else
+    /* Look up long options through test1_matcher when testit.sh asks. */
+    if (getenv("TEST1_MATCHER") != NULL) {
+	optTable = poptCompileTableMatcher(options, &test1_matcher);
+	if (optTable == NULL) {
+	    fprintf(stderr, "test1: test1.opts does not match the option tables\n");
+	    exit(EXIT_FAILURE);
+	}
+	optCon = poptGetCompiledContext("test1", nargc, argv, optTable, flags);
+    } else
+    optCon = poptGetContext("test1", nargc, argv, options, flags);
 #ifdef HAVE_STDLIB_H
     testpoptrc = getenv ("testpoptrc");
     if (testpoptrc != NULL )
@@ -287,10 +363,20 @@ int main(int argc, const char ** argv)
 
     poptSetExecPath(optCon, ".", 1);
 
+    /* Rebind a context created for argv[0] alone when testit.sh asks. */
+    if (rebind && (rc = poptRebindContext(optCon, argc, argv)) != 0) {
+	fprintf(stderr, "test1: %s\n", poptStrerror(rc));
+	ec = 2;
+	goto exit;
+    }
+
 #if 1
     while ((rc = poptGetNextOpt(optCon)) > 0)	/* Read all the options ... */
 	{};
 
+    if (rebind)
+	(void) poptRebindContext(optCon, argc, argv);
+    else
     poptResetContext(optCon);			/* ... and then start over. */
 /*@-modobserver@*/
     resetVars();
@@ -344,6 +430,14 @@ int main(int argc, const char ** argv)
 
     if (aCounter != bCounter)
 	fprintf(stdout, " aCounter: %d", aCounter);
+    {	const long long * stk = NULL;
+	int i, n = poptGetCalcStack(optCon, &stk);
+	if (n > 1) {
+	    fprintf(stdout, " calc:");
+	    for (i = 0; i < n; i++)
+		fprintf(stdout, " %" LONG_LONG_FORMAT, stk[i]);
+	}
+    }
 
     if (aArgv != NULL) {
 	const char **av = aArgv;
@@ -352,6 +446,12 @@ int main(int argc, const char ** argv)
 	while ((arg = *av++) != NULL)
 	    fprintf(stdout, " %s", arg);
     }
+    if (cArgv != NULL) {
+	int i;
+	fprintf(stdout, " cArgv(%d):", poptArgvCount(cArgv));
+	for (i = 0; i < poptArgvCount(cArgv); i++)
+	    fprintf(stdout, " %s", cArgv[i]);
+    }
     if (aBits) {
 	const char * separator = " ";
 	size_t i;
@@ -367,6 +467,8 @@ int main(int argc, const char ** argv)
     if (oStr != (char *)-1)
 	fprintf(stdout, " oStr: %s", (oStr ? oStr : "(none)"));
 /*@=nullpass@*/
+    if (bStr != NULL)
+	fprintf(stdout, " bStr: %s", bStr);
     if (singleDash)
 	fprintf(stdout, " -");
 
@@ -385,6 +487,8 @@ int main(int argc, const char ** argv)
 
 exit:
     optCon = poptFreeContext(optCon);
+    optTable = poptFreeCompiledTable(optTable);
+    free(block);
 #if defined(HAVE_MCHECK_H) && defined(HAVE_MTRACE)
     /*@-moduncon -noeffectuncon@*/
     muntrace();   /* Trace malloc only if MALLOC_TRACE=mtrace-output-file. */
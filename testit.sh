@@ -27,6 +27,22 @@ run() {
 	echo "Test \"$prog $*\" failed with: \"$result\" != \"$answer\" "
 	exit 2
     fi
+
+    # Run test1 again through a table compiled with poptCompileTable, and
+    # through its poptgen generated long option matcher, with parse-time
+    # memory from a context arena, rebinding the context.
+    if [ "$prog" = test1 ] && [ -z "$TEST1_MATCHER$TEST1_COMPILED" ]; then
+	test1name=$name
+	test1answer=$answer
+	TEST1_COMPILED=1; export TEST1_COMPILED
+	run $prog "$test1name (compiled)" "$test1answer" "$@"
+	unset TEST1_COMPILED
+	TEST1_MATCHER=1; export TEST1_MATCHER
+	TEST1_ARENA=1; export TEST1_ARENA
+	TEST1_REBIND=1; export TEST1_REBIND
+	run $prog "$test1name (matcher, arena, rebind)" "$test1answer" "$@"
+	unset TEST1_MATCHER TEST1_ARENA TEST1_REBIND
+    fi
 }
 
 run_diff() {
@@ -191,6 +207,73 @@ Help options:
   -?, --help                      Show this help message
       --usage                     Display brief usage message" --help
 
+run test1 "test1 - 62" "arg1: 0 arg2: (none) aFlag: 0x8888" --no-bitset
+run test1 "test1 - 63" "test1: bad argument --noarg1: unknown option" --noarg1
+run test1 "test1 - 64" "callback: c arg for cb2 foo callback: c sampledata foo arg1: 0 arg2: (none)" -c foo
+
+# Unique long option prefixes, only with POPT_CONTEXT_ALLOW_ABBREV.
+TEST1_ABBREV=1; export TEST1_ABBREV
+run test1 "test1 - 65" "arg1: 0 arg2: (none) aCounter: 34544" --verb
+run test1 "test1 - 66" "test1: bad argument --arg: ambiguous option" --arg
+run test1 "test1 - 67" "arg1: 0 arg2: (none) aFlag: 0xface" --nobitc
+unset TEST1_ABBREV
+
+# Parse in a caller supplied block, without malloc (sized without aliases
+# that append or substitute arguments).
+TEST1_BLOCK=1; export TEST1_BLOCK
+run test1 "test1 - 68" "arg1: 1 arg2: something arg3: 50 rest: foo" --arg1 --arg2 something foo -3 50
+run test1 "test1 - 69" "arg1: 1 arg2: alias" --two
+run test1 "test1 - 70" "test1: bad argument foo: memory allocation failed" --argv foo
+TEST1_BLOCK=small
+run test1 "test1 - 71" "test1: memory allocation failed" --arg1
+unset TEST1_BLOCK
+
+run test1 "test1 - 72" "arg1: 0 arg2: (none) bStr: payload" --borrow payload
+run test1 "test1 - 73" "arg1: 0 arg2: (none) bStr: 'foo bar' rest: baz" --grabborrow bar baz
+run test1 "test1 - 74" "arg1: 0 arg2: 'bar and bar' rest: baz" --grabtwice bar baz
+run test1 "test1 - 75" "arg1: 0 arg2: (none) cArgv(9): a b c d e f g h i" --cargv a --cargv b --cargv c --cargv d --cargv e --cargv f --cargv g --cargv h --cargv i
+run test1 "test1 - 76" "arg1: 0 arg2: (none) aCounter: 34548" -v --scale -2 --add
+run test1 "test1 - 77" "test1: bad argument --sum: stack underflow" --sum
+run test1 "test1 - 78" "arg1: 0 arg2: (none) aCounter: 34544 calc: 5 7 34544" --mark 5 --mark 7 -v
+run test1 "test1 - 79" "arg1: 0 arg2: (none) aCounter: 34549" --mark 5 --sum
+run test1 "test1 - 80" "arg1: 0 arg2: (none) aInt: 4000" -i 4K
+run test1 "test1 - 81" "arg1: 0 arg2: (none) aInt: -2048" -i -2Ki
+run test1 "test1 - 82" "arg1: 0 arg2: (none) aLongLong: 1099511627776" -L 1Ti
+run test1 "test1 - 83" "test1: bad argument 3G: number too large or too small" -i 3G
+run test1 "test1 - 84" "test1: bad argument 4Kx: invalid numeric value" -i 4Kx
+run test1 "test1 - 85" "arg1: 0 arg2: (none) aLongLong: 9223372036854775807" -L 9223372036854775807
+run test1 "test1 - 86" "test1: bad argument 9223372036854775808: number too large or too small" -L 9223372036854775808
+run test1 "test1 - 87" "arg1: 0 arg2: (none) aDouble: 1e+22" -d 1e22
+run test1 "test1 - 88" "arg1: 0 arg2: (none) aDouble: 1.5e+300" -d 1.5e300
+run test1 "test1 - 89" "test1: bad argument 1e-400: number too large or too small" -d 1e-400
+run test1 "test1 - 90" "arg1: 0 arg2: (none) aBits: foo,baz" --bits a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14,a15,a16,a17,bar,!bar,foo,a18,,baz
+# Long option prefixes are unknown without POPT_CONTEXT_ALLOW_ABBREV.
+run test1 "test1 - 91" "test1: bad argument --verb: unknown option" --verb
+# Values left on the calculator stack by many options are dropped, oldest first.
+run test1 "test1 - 92" "arg1: 0 arg2: (none) aCounter: 34569 calc: 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 34569" --mark 1 --mark 2 --mark 3 --mark 4 --mark 5 --mark 6 --mark 7 --mark 8 --mark 9 --mark 10 --mark 11 --mark 12 --mark 13 --mark 14 --mark 15 --mark 16 --mark 17 --mark 18 --mark 19 --mark 20 --mark 21 --mark 22 --mark 23 --mark 24 --mark 25 --sum
+# The decimal point is always '.', whatever the locale.
+run test1 "test1 - 93" "test1: bad argument 1,5: invalid numeric value" -d 1,5
+# Even where it is ',', if a locale like that is installed (too many digits
+# to convert exactly, so strtod(3) is used).
+comma=
+for loc in de_DE.UTF-8 de_DE.utf8 fr_FR.UTF-8 fr_FR.utf8 nl_NL.UTF-8 nl_NL.utf8 ru_RU.UTF-8 ru_RU.utf8
+do
+    if [ "`LC_ALL=$loc locale decimal_point 2>/dev/null`" = "," ]
+    then
+	comma=$loc
+	break
+    fi
+done
+if [ -n "$comma" ]
+then
+TEST1_LOCALE=$comma; export TEST1_LOCALE
+run test1 "test1 - 94" "arg1: 0 arg2: (none) aDouble: 0,125" -d 0.12500000000000000000001
+run test1 "test1 - 95" "test1: bad argument 0,12500000000000000000001: invalid numeric value" -d 0,12500000000000000000001
+unset TEST1_LOCALE
+else
+echo "Skipping test1 - 94 and 95: no locale with a decimal comma."
+fi
+
 ###################
 # End test1 test
 ###################
@@ -521,16 +604,114 @@ dpkg:	YES
 ipkg:	NO
 total(5) = hits(4) + misses(1)" a b rpm dpkg ipkg
 run tdict "tdict - 2" "\
-Usage: tdict [-?] [-d|--debug] [-v|--verbose] [-?|--help] [--usage]" --usage
+Usage: tdict [-?] [-b|--blocked] [--bench] [-c|--counting] [--check]
+        [-d|--debug] [-D|--dict=FILE] [-p|--fp=RATE] [-M|--map=FILE]
+        [-S|--save=FILE] [-U|--unload=FILE] [-v|--verbose] [-?|--help]
+        [--usage]" --usage
 run tdict "tdict - 3" "\
 Usage: tdict [OPTION...]
-  -d, --debug       Set debugging.
-  -v, --verbose     Set verbosity.
+  -b, --blocked         Keep all the bits of a word in one cache line.
+      --bench           Measure lookup rate and false positives.
+  -c, --counting        Count bits, so that words can be deleted.
+      --check           Check counts and set operations bit by bit.
+  -d, --debug           Set debugging.
+  -D, --dict=FILE       Dictionary to load.
+  -p, --fp=RATE         Target false positive rate.
+  -M, --map=FILE        Use a saved filter instead of loading the dictionary.
+  -S, --save=FILE       Save the dictionary filter.
+  -U, --unload=FILE     Delete the words in FILE from the filter.
+  -v, --verbose         Set verbosity.
 
 Help options:
-  -?, --help        Show this help message
-      --usage       Display brief usage message" --help
+  -?, --help            Show this help message
+      --usage           Display brief usage message" --help
+run tdict "tdict - 4" "\
+===== Some words are in /usr/share/dict/words
+a:	YES
+b:	YES
+rpm:	YES
+dpkg:	YES
+total(4) = hits(4) + misses(0)" -b -p 0.0001 a b rpm dpkg
 fi
+printf 'a\nb\nrpm\ndpkg\n' > $builddir/tdict.words
+run tdict "tdict - 5" "\
+===== Some words are in $builddir/tdict.words
+rpm:	YES
+ipkg:	NO
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words -b -S $builddir/tdict.bits rpm ipkg
+run tdict "tdict - 6" "\
+===== Some words are in $builddir/tdict.bits
+rpm:	YES
+ipkg:	NO
+total(2) = hits(1) + misses(1)" -M $builddir/tdict.bits rpm ipkg
+run tdict "tdict - 7" "tdict: $builddir/tdict.words: bad bit set file" -M $builddir/tdict.words rpm
+printf 'a\nb\nrpm\ndpkg\n!rpm\n' > $builddir/tdict.words
+run tdict "tdict - 8" "\
+===== Some words are in $builddir/tdict.words
+rpm:	NO
+dpkg:	YES
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words -c rpm dpkg
+run tdict "tdict - 9" "\
+===== Some words are in $builddir/tdict.words
+rpm:	NO
+dpkg:	YES
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words -b -c rpm dpkg
+# Deleting words that were never added (and none of which checks present)
+# must not lose any that were.
+printf 'a\nb\nrpm\ndpkg\n' > $builddir/tdict.words
+i=0
+while [ $i -lt 100 ]; do echo "absent$i"; i=`expr $i + 1`; done > $builddir/tdict.absent
+run tdict "tdict - 10" "\
+===== Some words are in $builddir/tdict.words
+a:	YES
+b:	YES
+rpm:	YES
+dpkg:	YES
+total(4) = hits(4) + misses(0)" -D $builddir/tdict.words -U $builddir/tdict.absent -c -p 0.000001 a b rpm dpkg
+run tdict "tdict - 11" "\
+===== Some words are in $builddir/tdict.words
+a:	YES
+b:	YES
+rpm:	YES
+dpkg:	YES
+total(4) = hits(4) + misses(0)" -D $builddir/tdict.words -U $builddir/tdict.absent -b -c -p 0.000001 a b rpm dpkg
+# Popcounts, estimates, unions and intersections of sets of 1 to 40 words,
+# which take 1 to 18 words of bits (not just multiples of 4).
+i=0
+while [ $i -lt 40 ]; do echo "word$i"; i=`expr $i + 1`; done > $builddir/tdict.words
+run tdict "tdict - 12" "\
+===== classic sets of 1 to 40 words in 1 to 18 words of bits
+errors: popcount(0) union(0) intersect(0) estimate(0)
+bits set(289/576) estimated words(40.1)
+===== Some words are in $builddir/tdict.words
+word0:	YES
+absent:	NO
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words --check word0 absent
+run tdict "tdict - 13" "\
+===== blocked sets of 1 to 40 words in 16 to 32 words of bits
+errors: popcount(0) union(0) intersect(0) estimate(0)
+bits set(324/1024) estimated words(39.0)
+===== Some words are in $builddir/tdict.words
+word0:	YES
+absent:	NO
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words -b --check word0 absent
+run tdict "tdict - 14" "\
+===== classic counting sets of 1 to 40 words in 4 to 72 words of bits
+errors: popcount(0) union(0) intersect(0) estimate(0)
+bits set(289/576) estimated words(40.1)
+===== Some words are in $builddir/tdict.words
+word0:	YES
+absent:	NO
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words -c --check word0 absent
+run tdict "tdict - 15" "\
+===== blocked counting sets of 1 to 40 words in 16 to 80 words of bits
+errors: popcount(0) union(0) intersect(0) estimate(0)
+bits set(285/640) estimated words(37.7)
+===== Some words are in $builddir/tdict.words
+word0:	YES
+absent:	NO
+total(2) = hits(1) + misses(1)" -D $builddir/tdict.words -b -c --check word0 absent
+rm -f $builddir/tdict.words $builddir/tdict.bits $builddir/tdict.absent
 ###################
 # End tdict test
 ###################
@@ -547,6 +728,32 @@ run_diff test3 "test3 - 3" $srcdir/test3-data/03.input $srcdir/test3-data/03.ans
 # End   test3 test
 ###################
 
+###################
+# Begin tscale test
+###################
+
+# CPU time ratios are too noisy under make -j or valgrind to check by default.
+if [ -n "$POPT_TIMING_TESTS" ]
+then
+run tscale "tscale - 1" ""
+fi
+
+###################
+# End   tscale test
+###################
+
+###################
+# Begin tthread test
+###################
+
+run tthread "tthread - 1" ""
+run tthread "tthread - 2" "" -b
+run tthread "tthread - 3" "" -b -c
+
+###################
+# End   tthread test
+###################
+
 # If called from VALGRIND_ENVIRONMENT 
 [ -s $builddir/popt-valgrind-result ] && { echo "Some test fail under Valgrind. Check $builddir/popt-valgrind-result" && exit 1 ; }
 
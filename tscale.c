@@ -0,0 +1,266 @@
+#include "system.h"
+#include <stdio.h>
+#include <time.h>
+#include "popt.h"
+
+/*
+ * Parse synthetic argv's of n/4 and n arguments, and fail if 4 times the
+ * arguments take much more than 4 times as long. Anything that grows by a
+ * constant (or rescans what it has) on every argument is O(n^2), and shows
+ * up here as a ratio near 16. testit.sh runs this only if POPT_TIMING_TESTS
+ * is set in the environment.
+ */
+
+static int _debug = 0;
+static int _verbose = 0;
+static int nargs = 1000000;
+static double maxratio = 10.0;
+
+/*@unchecked@*/
+static const char ** adds = NULL;
+/*@unchecked@*/
+static const char ** defines = NULL;
+/*@unchecked@*/
+static const char ** includes = NULL;
+
+static struct poptOption scaleOptions[] = {
+  { "add", 'a', POPT_ARG_ARGV,			&adds, 0,
+	"repeated POPT_ARG_ARGV option", NULL },
+  { "define", 'D', POPT_ARG_COUNTED_ARGV,	&defines, 0,
+	"repeated POPT_ARG_COUNTED_ARGV option", NULL },
+  { "flag", 'f', POPT_ARG_NONE,			NULL, 0,
+	"flag", NULL },
+  { "include", 'I', POPT_ARG_ARGV,		&includes, 0,
+	"repeated POPT_ARG_ARGV option, alternating with --add", NULL },
+  POPT_TABLEEND
+};
+
+static double now(void)
+{
+    return (double)clock() / (double)CLOCKS_PER_SEC;
+}
+
+/*
+ * An xargs(1)-like argv: files, a repeated --add, --include and -D, and
+ * some flags.
+ */
+static const char ** mkArgv(int n, char ** bp, int * nfilesp, int * ndefsp)
+{
+    const char ** av = (const char **) malloc((n + 1) * sizeof(*av));
+    char * b = (char *) malloc((size_t)n * 16);
+    char * be = b;
+    int i;
+
+    if (av == NULL || b == NULL) {
+	fprintf(stderr, "tscale: out of memory\n");
+	exit(2);
+    }
+    *nfilesp = 0;
+    *ndefsp = 0;
+    av[0] = "tscale";
+    for (i = 1; i < n; i++) {
+	av[i] = be;
+	switch (i % 4) {
+	case 1:
+	    if (i % 16 == 1)
+		be += sprintf(be, "--add=%d", i);
+	    else if (i % 16 == 9)
+		be += sprintf(be, "--include=%d", i);
+	    else
+		be += sprintf(be, "-DFOO%d", i), (*ndefsp)++;
+	    break;
+	case 2:	be += sprintf(be, "-f");		break;
+	default:be += sprintf(be, "file%d", i);	(*nfilesp)++;	break;
+	}
+	be++;
+    }
+    av[n] = NULL;
+    *bp = b;
+    return av;
+}
+
+static const char ** freeArgv(const char ** argv)
+{
+    int i;
+
+    if (argv != NULL) {
+	for (i = 0; argv[i] != NULL; i++)
+	    free((void *)argv[i]);
+	free(argv);
+    }
+    return NULL;
+}
+
+static double parseArgv(int n)
+{
+    char * b = NULL;
+    int nfiles = 0;
+    int ndefs = 0;
+    const char ** av = mkArgv(n, &b, &nfiles, &ndefs);
+    poptContext con;
+    double t;
+    int rc;
+    int i;
+
+    t = now();
+    con = poptGetContext("tscale", n, av, scaleOptions, 0);
+    while ((rc = poptGetNextOpt(con)) > 0)
+	;
+    if (rc != -1) {
+	fprintf(stderr, "tscale: %s: %s\n", poptBadOption(con, 0),
+		poptStrerror(rc));
+	exit(2);
+    }
+    i = 0;
+    if (poptGetArgs(con) != NULL)
+	while (poptGetArgs(con)[i] != NULL)
+	    i++;
+    con = poptFreeContext(con);
+    t = now() - t;
+
+    if (i != nfiles) {
+	fprintf(stderr, "tscale: %d of %d leftovers\n", i, nfiles);
+	exit(2);
+    }
+    if (poptArgvCount(defines) != ndefs) {
+	fprintf(stderr, "tscale: %d of %d defines\n",
+		poptArgvCount(defines), ndefs);
+	exit(2);
+    }
+    defines = poptFreeArgv(defines);
+    adds = freeArgv(adds);
+    includes = freeArgv(includes);
+    free(av);
+    free(b);
+    return t;
+}
+
+static double parseString(int n)
+{
+    char * s = (char *) malloc((size_t)n * 16);
+    char * se = s;
+    const char ** av = NULL;
+    int ac = 0;
+    double t;
+    int i;
+
+    if (s == NULL) {
+	fprintf(stderr, "tscale: out of memory\n");
+	exit(2);
+    }
+    for (i = 0; i < n; i++)
+	se += sprintf(se, (i % 2 ? " 'arg %d'" : " arg%d"), i);
+
+    t = now();
+    if (poptParseArgvString(s, &ac, &av) != 0 || ac != n) {
+	fprintf(stderr, "tscale: poptParseArgvString: %d of %d\n", ac, n);
+	exit(2);
+    }
+#if !defined(SUPPORT_CONTIGUOUS_ARGV)
+    for (i = 0; i < ac; i++)
+	free((void *)av[i]);
+#endif
+    free(av);
+    t = now() - t;
+
+    free(s);
+    return t;
+}
+
+static double addAliases(int n)
+{
+    const char * av0[] = { "tscale", NULL };
+    poptContext con;
+    double t;
+    int i;
+
+    n /= 8;
+    con = poptGetContext("tscale", 1, av0, scaleOptions, 0);
+    t = now();
+    for (i = 0; i < n; i++) {
+	char name[32];
+	struct poptAlias alias;
+	const char ** av = NULL;
+	int ac = 0;
+
+	sprintf(name, "alias%d", i);
+	(void) poptParseArgvString("--flag", &ac, &av);
+	memset(&alias, 0, sizeof(alias));
+	alias.longName = name;
+	alias.argc = ac;
+	alias.argv = av;
+	if (poptAddAlias(con, alias, 0)) {
+	    fprintf(stderr, "tscale: poptAddAlias failed\n");
+	    exit(2);
+	}
+    }
+    con = poptFreeContext(con);
+    t = now() - t;
+    return t;
+}
+
+/* Best of 3, to keep a noisy machine from failing the check. */
+static double best(double (*fn) (int), int n)
+{
+    double t = 0.0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	double u = fn(n);
+	if (i == 0 || u < t)
+	    t = u;
+    }
+    return t;
+}
+
+static int check(const char * name, double (*fn) (int))
+{
+    double t1 = best(fn, nargs / 4);
+    double t4 = best(fn, nargs);
+    /* Too fast to time is linear enough. */
+    double ratio = (t4 < 0.01 ? 4.0 : t4 / (t1 > 0.001 ? t1 : 0.001));
+
+if (_verbose)
+fprintf(stderr, "%s: %d %.3fs %d %.3fs ratio %.2f\n",
+		name, nargs / 4, t1, nargs, t4, ratio);
+
+    if (ratio > maxratio) {
+	fprintf(stderr, "tscale: %s: %d args take %.1fx as long as %d args\n",
+		name, nargs, ratio, nargs / 4);
+	return 1;
+    }
+    return 0;
+}
+
+static struct poptOption optionsTable[] = {
+  { "debug", 'd', POPT_BIT_SET|POPT_ARGFLAG_TOGGLE,	&_debug, 1,
+	"Set debugging.", NULL },
+  { "nargs", 'n', POPT_ARG_INT,		&nargs, 0,
+	"No. of arguments to parse.", "N" },
+  { "verbose", 'v', POPT_BIT_SET|POPT_ARGFLAG_TOGGLE,	&_verbose, 1,
+	"Set verbosity.", NULL },
+  POPT_AUTOALIAS
+  POPT_AUTOHELP
+  POPT_TABLEEND
+};
+
+int main(int argc, const char ** argv)
+{
+    poptContext optCon;
+    int ec = 0;
+
+    optCon = poptGetContext(argv[0], argc, argv, optionsTable, 0);
+    if (poptGetNextOpt(optCon) < -1 || nargs < 64) {
+	poptPrintUsage(optCon, stderr, 0);
+	ec = 2;
+	goto exit;
+    }
+
+    ec |= check("argv", parseArgv);
+    ec |= check("poptParseArgvString", parseString);
+    ec |= check("poptAddAlias", addAliases);
+
+exit:
+    optCon = poptFreeContext(optCon);
+    return ec;
+}
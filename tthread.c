@@ -0,0 +1,207 @@
+#include "system.h"
+#include <stdio.h>
+#include "popt.h"
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+/*
+ * Fill one bit set from 1, 2, 4 ... threads at once with poptBitsAddAtomic,
+ * and fail if any key is then missing, either to the thread that added it
+ * or to the others, or if the set differs from one filled by a single
+ * thread with poptBitsAdd. With -v, print how the insert rate scales.
+ */
+
+static int _debug = 0;
+static int _verbose = 0;
+static int nkeys = 1000000;
+static int nthreads = 4;
+static double fpr = 0.01;
+static unsigned int bitsFlags = 0;
+
+static char (*keys)[16] = NULL;
+
+typedef struct worker_s {
+    poptBits bits;
+    int first;			/* first key */
+    int n;			/* no. of keys */
+    int errors;			/* keys missing, or failed calls */
+} * worker;
+
+#if defined(HAVE_PTHREAD_H)
+static double now(void)
+{
+    struct timeval tv;
+    (void) gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/* Add a slice of the keys, checking each as soon as it is added. */
+static void * addKeys(void * arg)
+{
+    worker w = (worker) arg;
+    int i;
+
+    for (i = w->first; i < w->first + w->n; i++) {
+	if (poptBitsAddAtomic(w->bits, keys[i]) != 0
+	 || poptBitsChkAtomic(w->bits, keys[i]) != 1)
+	    w->errors++;
+    }
+    return NULL;
+}
+
+/* Check a slice of the keys (added by some other thread). */
+static void * chkKeys(void * arg)
+{
+    worker w = (worker) arg;
+    int i;
+
+    for (i = w->first; i < w->first + w->n; i++) {
+	if (poptBitsChkAtomic(w->bits, keys[i]) != 1)
+	    w->errors++;
+    }
+    return NULL;
+}
+
+/* Run fn over all the keys, split between nt threads. */
+static int runThreads(void * (*fn) (void *), poptBits bits, int nt, int shift)
+{
+    pthread_t tids[64];
+    struct worker_s ws[64];
+    int errors = 0;
+    int i;
+
+    for (i = 0; i < nt; i++) {
+	int j = (i + shift) % nt;
+	ws[i].bits = bits;
+	ws[i].first = (int) (((long long) nkeys * j) / nt);
+	ws[i].n = (int) (((long long) nkeys * (j + 1)) / nt) - ws[i].first;
+	ws[i].errors = 0;
+	if (pthread_create(&tids[i], NULL, fn, &ws[i]) != 0) {
+	    fprintf(stderr, "tthread: pthread_create failed\n");
+	    exit(2);
+	}
+    }
+    for (i = 0; i < nt; i++) {
+	(void) pthread_join(tids[i], NULL);
+	errors += ws[i].errors;
+    }
+    return errors;
+}
+
+static int check(int nt, unsigned int npop, double * t1p)
+{
+    poptBits bits = poptBitsCreate((unsigned) nkeys, fpr, bitsFlags);
+    double t;
+    int nadd;
+    int nchk;
+    int ec = 0;
+
+    if (bits == NULL) {
+	fprintf(stderr, "tthread: poptBitsCreate failed\n");
+	exit(2);
+    }
+
+    t = now();
+    nadd = runThreads(addKeys, bits, nt, 0);
+    t = now() - t;
+    /* Each thread checks keys that some other thread added. */
+    nchk = runThreads(chkKeys, bits, nt, 1);
+
+    if (nt == 1)
+	*t1p = t;
+if (_verbose)
+fprintf(stderr, "%2d threads: %d inserts in %.3fs = %.2f Minserts/s (%.2fx)\n",
+		nt, nkeys, t, (t > 0.0 ? nkeys / t / 1e6 : 0.0),
+		(t > 0.0 ? *t1p / t : 0.0));
+
+    if (nadd || nchk) {
+	fprintf(stderr, "tthread: %d threads: %d keys missing while adding, %d after\n",
+		nt, nadd, nchk);
+	ec = 1;
+    }
+    if (poptBitsPopcount(bits) != npop) {
+	fprintf(stderr, "tthread: %d threads: %u bits set, not %u\n",
+		nt, poptBitsPopcount(bits), npop);
+	ec = 1;
+    }
+    bits = poptBitsFree(bits);
+    return ec;
+}
+#endif
+
+static struct poptOption optionsTable[] = {
+  { "blocked", 'b', POPT_BIT_SET, &bitsFlags, POPT_BITS_BLOCKED,
+	"Keep all the bits of a key in one cache line.", NULL },
+  { "counting", 'c', POPT_BIT_SET, &bitsFlags, POPT_BITS_COUNTING,
+	"Count bits, so that keys can be deleted.", NULL },
+  { "debug", 'd', POPT_ARG_VAL,	&_debug, 1,
+	"Set debugging.", NULL },
+  { "nkeys", 'n', POPT_ARG_INT,		&nkeys, 0,
+	"No. of keys to add.", "N" },
+  { "threads", 't', POPT_ARG_INT,	&nthreads, 0,
+	"Most threads to add keys with.", "N" },
+  { "verbose", 'v', POPT_ARG_VAL,	&_verbose, 1,
+	"Set verbosity.", NULL },
+  POPT_AUTOALIAS
+  POPT_AUTOHELP
+  POPT_TABLEEND
+};
+
+int main(int argc, const char ** argv)
+{
+    poptContext optCon;
+    int ec = 0;
+
+    optCon = poptGetContext(argv[0], argc, argv, optionsTable, 0);
+    if (poptGetNextOpt(optCon) < -1 || nkeys < 1
+     || nthreads < 1 || nthreads > 64) {
+	poptPrintUsage(optCon, stderr, 0);
+	ec = 2;
+	goto exit;
+    }
+
+#if defined(HAVE_PTHREAD_H)
+    {	poptBits bits = poptBitsCreate((unsigned) nkeys, fpr, bitsFlags);
+	unsigned int npop;
+	double t1 = 0.0;
+	int nt;
+	int i;
+
+	keys = malloc((size_t) nkeys * sizeof(*keys));
+	if (bits == NULL || keys == NULL) {
+	    fprintf(stderr, "tthread: out of memory\n");
+	    exit(2);
+	}
+	/* Built without atomics, there is nothing to test. */
+	if (poptBitsChkAtomic(bits, "key") == POPT_ERROR_BADOPERATION) {
+if (_verbose)
+fprintf(stderr, "tthread: no atomics to test\n");
+	    nthreads = 0;
+	}
+	/* The set a single thread fills with plain poptBitsAdd. */
+	for (i = 0; i < nkeys; i++) {
+	    sprintf(keys[i], "key%d", i);
+	    (void) poptBitsAdd(bits, keys[i]);
+	}
+	npop = poptBitsPopcount(bits);
+	bits = poptBitsFree(bits);
+
+	for (nt = 1; nthreads > 0; nt = (2 * nt < nthreads ? 2 * nt : nthreads)) {
+	    ec |= check(nt, npop, &t1);
+	    if (nt >= nthreads)
+		break;
+	}
+	free(keys);
+	keys = NULL;
+    }
+#else
+if (_verbose)
+fprintf(stderr, "tthread: no threads to test\n");
+#endif
+
+exit:
+    optCon = poptFreeContext(optCon);
+    return ec;
+}